@@ -1,8 +1,13 @@
 ﻿#ifndef MATH_H_
 #define MATH_H_
 
-#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
 #include <iostream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 template<class T>
 static T min(T x, T y, T z) { return std::min<T>(std::min<T>(x, y), z); }
@@ -18,15 +23,9 @@ struct Vec2 {
     t x, y;
     Vec2<t>() : x(t()), y(t()) {}
     Vec2<t>(t _x, t _y) : x(_x), y(_y) {}
-    Vec2<t>(const Vec2<t> &v) : x(t()), y(t()) { *this = v; }
-
-    Vec2<t> &operator=(const Vec2<t> &v) {
-        if (this != &v) {
-            x = v.x;
-            y = v.y;
-        }
-        return *this;
-    }
+    // 默认的拷贝，保持 trivially copyable，顶点数组可以整块 memcpy（网格缓存）
+    Vec2<t>(const Vec2<t> &v) = default;
+    Vec2<t> &operator=(const Vec2<t> &v) = default;
 
     Vec2<t> operator+(const Vec2<t> &V) const { return Vec2<t>(x + V.x, y + V.y); }
 
@@ -45,15 +44,8 @@ struct Vec3 {
     t x, y, z;
     Vec3<t>() : x(t()), y(t()), z(t()) {}
     Vec3<t>(t _x, t _y, t _z) : x(_x), y(_y), z(_z) {}
-    Vec3<t>(const Vec3<t> &v) : x(t()), y(t()), z(t()) { *this = v; }
-    Vec3<t> &operator=(const Vec3<t> &v) {
-        if (this != &v) {
-            this->x = v.x;
-            this->y = v.y;
-            this->z = v.z;
-        }
-        return *this;
-    }
+    Vec3<t>(const Vec3<t> &v) = default;
+    Vec3<t> &operator=(const Vec3<t> &v) = default;
 
     Vec3<t> operator+(const Vec3<t> &v) const { return Vec3<t>(this->x + v.x, this->y + v.y, this->z + v.z); }
 
@@ -88,22 +80,15 @@ struct Vec4 {
     t x, y, z, w;
     Vec4<t>() : x(t()), y(t()), z(t()), w(t()) {}
     Vec4<t>(t _x, t _y, t _z, t _w) : x(_x), y(_y), z(_z), w(_w) {}
-    Vec4<t>(const Vec4<t> &v) : x(t()), y(t()), z(t()), w(t()) { *this = v; }
-    Vec4<t> &operator=(const Vec4<t> &v) {
-        if (this != &v) {
-            x = v.x;
-            y = v.y;
-            z = v.z;
-            w = v.w;
-        }
-        return *this;
-    }
+    Vec4<t>(const Vec3<t> &v, t _w) : x(v.x), y(v.y), z(v.z), w(_w) {}
+    Vec4<t>(const Vec4<t> &v) = default;
+    Vec4<t> &operator=(const Vec4<t> &v) = default;
 
     Vec4<t> operator+(const Vec4<t> &v) const { return Vec4<t>(x + v.x, y + v.y, z + v.z, w + v.w); }
 
     Vec4<t> operator-(const Vec4<t> &v) const { return Vec4<t>(x - v.x, y - v.y, z - v.z, w - v.w); }
 
-    Vec4<t> operator*(float f) const { return Vec3<t>(x * f, y * f, z * f, w * f); }
+    Vec4<t> operator*(float f) const { return Vec4<t>(x * f, y * f, z * f, w * f); }
 
     t operator*(const Vec4<t> &v) const { return x * v.x + y * v.y + z * v.z + w * v.w; }
 
@@ -121,6 +106,8 @@ struct Vec4 {
         else return w;
     }
 
+    [[nodiscard]] Vec3<t> xyz() const { return Vec3<t>(x, y, z); }
+
     template<class>
     friend std::ostream &operator<<(std::ostream &s, Vec4<t> &v);
 };
@@ -162,6 +149,193 @@ typedef Vec3<int> Vec3i;
 typedef Vec4<float> Vec4f;
 
 
+/*
+    定长矩阵，数据放在栈上，可平凡拷贝，变换的热路径上使用
+    Matrix 每次构造都要在堆上分配 vector<vector<float>>
+*/
+template <int N>
+struct Mat {
+    static_assert(N == 3 || N == 4, "only Mat3 and Mat4 are supported");
+    float m[N][N]{};
+
+    constexpr Mat() = default;
+
+    /// 按行优先填充，和 Matrix(std::vector<float>) 一致
+    constexpr Mat(std::initializer_list<float> nums) {
+        int i = 0;
+        for (float f : nums) {
+            if (i >= N * N) break;
+            m[i / N][i % N] = f;
+            i++;
+        }
+    }
+
+    static constexpr Mat identity() {
+        Mat I;
+        for (int i = 0; i < N; i++) I.m[i][i] = 1.f;
+        return I;
+    }
+
+    constexpr float *operator[](int i) { return m[i]; }
+
+    constexpr const float *operator[](int i) const { return m[i]; }
+
+    constexpr Mat operator*(const Mat &a) const {
+        Mat res;
+        for (int i = 0; i < N; i++) {
+            for (int j = 0; j < N; j++) {
+                float sum = 0.f;
+                for (int k = 0; k < N; k++) sum += m[i][k] * a.m[k][j];
+                res.m[i][j] = sum;
+            }
+        }
+        return res;
+    }
+
+    constexpr Mat operator+(const Mat &a) const {
+        Mat res;
+        for (int i = 0; i < N; i++)
+            for (int j = 0; j < N; j++)
+                res.m[i][j] = m[i][j] + a.m[i][j];
+        return res;
+    }
+
+    constexpr Mat operator*(float b) const {
+        Mat res;
+        for (int i = 0; i < N; i++)
+            for (int j = 0; j < N; j++)
+                res.m[i][j] = m[i][j] * b;
+        return res;
+    }
+
+    friend constexpr Mat operator*(float b, const Mat &a) { return a * b; }
+
+    constexpr Mat transpose() const {
+        Mat res;
+        for (int i = 0; i < N; i++)
+            for (int j = 0; j < N; j++)
+                res.m[j][i] = m[i][j];
+        return res;
+    }
+
+    /// 闭式展开的行列式，不再递归构造子矩阵
+    constexpr float det() const {
+        if constexpr (N == 3) {
+            return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                   m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                   m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+        } else {
+            float s[6]{}, c[6]{};
+            minors(s, c);
+            return s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] - s[4] * c[1] + s[5] * c[0];
+        }
+    }
+
+    /// 伴随矩阵 / 行列式，4x4 使用 2x2 子式展开（Laplace expansion theorem）
+    Mat inverse() const {
+        Mat res;
+        if constexpr (N == 3) {
+            float d = det();
+            if (std::abs(d) < 1e-6) throw std::runtime_error("error inverse");
+            float invDet = 1.f / d;
+            res.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * invDet;
+            res.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet;
+            res.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+            res.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * invDet;
+            res.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+            res.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet;
+            res.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * invDet;
+            res.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet;
+            res.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+        } else {
+            float s[6]{}, c[6]{};
+            minors(s, c);
+            float d = s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] - s[4] * c[1] + s[5] * c[0];
+            if (std::abs(d) < 1e-6) throw std::runtime_error("error inverse");
+            float invDet = 1.f / d;
+            res.m[0][0] = ( m[1][1] * c[5] - m[1][2] * c[4] + m[1][3] * c[3]) * invDet;
+            res.m[0][1] = (-m[0][1] * c[5] + m[0][2] * c[4] - m[0][3] * c[3]) * invDet;
+            res.m[0][2] = ( m[3][1] * s[5] - m[3][2] * s[4] + m[3][3] * s[3]) * invDet;
+            res.m[0][3] = (-m[2][1] * s[5] + m[2][2] * s[4] - m[2][3] * s[3]) * invDet;
+            res.m[1][0] = (-m[1][0] * c[5] + m[1][2] * c[2] - m[1][3] * c[1]) * invDet;
+            res.m[1][1] = ( m[0][0] * c[5] - m[0][2] * c[2] + m[0][3] * c[1]) * invDet;
+            res.m[1][2] = (-m[3][0] * s[5] + m[3][2] * s[2] - m[3][3] * s[1]) * invDet;
+            res.m[1][3] = ( m[2][0] * s[5] - m[2][2] * s[2] + m[2][3] * s[1]) * invDet;
+            res.m[2][0] = ( m[1][0] * c[4] - m[1][1] * c[2] + m[1][3] * c[0]) * invDet;
+            res.m[2][1] = (-m[0][0] * c[4] + m[0][1] * c[2] - m[0][3] * c[0]) * invDet;
+            res.m[2][2] = ( m[3][0] * s[4] - m[3][1] * s[2] + m[3][3] * s[0]) * invDet;
+            res.m[2][3] = (-m[2][0] * s[4] + m[2][1] * s[2] - m[2][3] * s[0]) * invDet;
+            res.m[3][0] = (-m[1][0] * c[3] + m[1][1] * c[1] - m[1][2] * c[0]) * invDet;
+            res.m[3][1] = ( m[0][0] * c[3] - m[0][1] * c[1] + m[0][2] * c[0]) * invDet;
+            res.m[3][2] = (-m[3][0] * s[3] + m[3][1] * s[1] - m[3][2] * s[0]) * invDet;
+            res.m[3][3] = ( m[2][0] * s[3] - m[2][1] * s[1] + m[2][2] * s[0]) * invDet;
+        }
+        return res;
+    }
+
+private:
+    /// 上两行和下两行的 2x2 子式，det 和 inverse 共用
+    constexpr void minors(float s[6], float c[6]) const {
+        s[0] = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+        s[1] = m[0][0] * m[1][2] - m[1][0] * m[0][2];
+        s[2] = m[0][0] * m[1][3] - m[1][0] * m[0][3];
+        s[3] = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+        s[4] = m[0][1] * m[1][3] - m[1][1] * m[0][3];
+        s[5] = m[0][2] * m[1][3] - m[1][2] * m[0][3];
+        c[5] = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+        c[4] = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+        c[3] = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+        c[2] = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+        c[1] = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+        c[0] = m[2][0] * m[3][1] - m[3][0] * m[2][1];
+    }
+};
+
+typedef Mat<3> Mat3;
+typedef Mat<4> Mat4;
+
+inline Vec4f operator*(const Mat4 &a, const Vec4f &v) {
+    float r[4];
+    for (int i = 0; i < 4; i++) {
+        float sum = 0.f;
+        sum += a.m[i][0] * v.x;
+        sum += a.m[i][1] * v.y;
+        sum += a.m[i][2] * v.z;
+        sum += a.m[i][3] * v.w;
+        r[i] = sum;
+    }
+    return {r[0], r[1], r[2], r[3]};
+}
+
+inline Vec3f operator*(const Mat3 &a, const Vec3f &v) {
+    float r[3];
+    for (int i = 0; i < 3; i++) {
+        float sum = 0.f;
+        sum += a.m[i][0] * v.x;
+        sum += a.m[i][1] * v.y;
+        sum += a.m[i][2] * v.z;
+        r[i] = sum;
+    }
+    return {r[0], r[1], r[2]};
+}
+
+static_assert(std::is_trivially_copyable<Mat4>::value, "Mat4 must stay trivially copyable");
+static_assert(Mat3::identity().det() == 1.f, "Mat3 det");
+static_assert(Mat4::identity().det() == 1.f, "Mat4 det");
+
+template <int N>
+std::ostream &operator<<(std::ostream &s, const Mat<N> &a) {
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < N; j++) {
+            s << a.m[i][j];
+            if (j < N - 1) s << "\t";
+        }
+        s << "\n";
+    }
+    return s;
+}
+
+
 class Matrix {
 private:
     std::vector<std::vector<float>> m;
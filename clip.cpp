@@ -0,0 +1,63 @@
+﻿#include "clip.h"
+
+#include <utility>
+
+
+namespace {
+
+/// 到裁剪平面的有向距离，内侧为正，对裁剪空间坐标是线性的
+enum class Plane { Near, Far, Left, Right, Bottom, Top };
+
+inline float planeDistance(const ClipVertex &v, Plane plane, const ScreenBounds &b) {
+    switch (plane) {
+        case Plane::Near: return v.z - b.depth * v.w;               // z / w <= depth
+        case Plane::Far: return -v.z;                               // z / w >= 0
+        case Plane::Left: return -b.guard * v.w - v.x;              // x / w >= -guard
+        case Plane::Right: return v.x - (b.width + b.guard) * v.w;  // x / w <= width + guard
+        case Plane::Bottom: return -b.guard * v.w - v.y;
+        default: return v.y - (b.height + b.guard) * v.w;
+    }
+}
+
+inline ClipVertex lerp(const ClipVertex &a, const ClipVertex &b, float t, int nVaryings) {
+    ClipVertex v;
+    v.x = a.x + (b.x - a.x) * t;
+    v.y = a.y + (b.y - a.y) * t;
+    v.z = a.z + (b.z - a.z) * t;
+    v.w = a.w + (b.w - a.w) * t;
+    for (int i = 0; i < nVaryings; i++) v.varyings[i] = a.varyings[i] + (b.varyings[i] - a.varyings[i]) * t;
+    return v;
+}
+
+/// 多边形 in 按一个平面裁剪到 out，返回 out 的顶点数
+int clipPolygon(const ClipVertex *in, int n, int nVaryings, Plane plane, const ScreenBounds &b, ClipVertex *out) {
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        const ClipVertex &cur = in[i], &next = in[(i + 1) % n];
+        float dc = planeDistance(cur, plane, b), dn = planeDistance(next, plane, b);
+        if (dc >= 0) out[m++] = cur;
+        if ((dc >= 0) != (dn >= 0)) out[m++] = lerp(cur, next, dc / (dc - dn), nVaryings);
+    }
+    return m;
+}
+
+} // namespace
+
+
+int clipTriangle(const ClipVertex *in, int nVaryings, const ScreenBounds &bounds, const ClipSettings &settings,
+                 ClipVertex *out) {
+    // 近平面必须最先裁，之后所有顶点 w < 0，保护带平面才有意义
+    ClipVertex buf[MAX_CLIP_VERTS];
+    ClipVertex *src = out, *dst = buf;
+    for (int i = 0; i < 3; i++) src[i] = in[i];
+    int n = 3;
+    for (Plane plane : {Plane::Near, Plane::Far, Plane::Left, Plane::Right, Plane::Bottom, Plane::Top}) {
+        if (plane == Plane::Far && !settings.farPlane) continue;
+        n = clipPolygon(src, n, nVaryings, plane, bounds, dst);
+        std::swap(src, dst);
+        if (n < 3) return 0;
+    }
+    if (src != out)
+        for (int i = 0; i < n; i++) out[i] = src[i];
+    return n;
+}
@@ -0,0 +1,52 @@
+﻿#ifndef CLIP_H_
+#define CLIP_H_
+
+#include "GMath.h"
+#include "vertex.h"
+
+
+/*
+    齐次裁剪空间中的三角形裁剪
+    跨过近平面的三角形有顶点 w >= 0，除以 w 之后屏幕坐标会翻转或趋于无穷，必须在除法之前裁掉
+    只是部分超出屏幕的三角形不裁，setupTriangle() 把包围盒截到屏幕内就行；
+    但顶点离屏幕太远时边函数的浮点精度不够，所以屏幕四周留一圈保护带 (guard band)，
+    只有超出保护带的三角形才按保护带的四条边裁剪
+    坐标是已经乘过 viewport 的裁剪空间坐标，相机前方 w < 0，屏幕坐标 = (x, y, z) / w
+*/
+
+/// 默认的保护带宽度，像素，见 ScreenBounds::guard
+/// 屏幕尺寸加上保护带不能超过 raster.h 的 MAX_RASTER_COORD，否则定点边函数放不下
+constexpr float GUARD_BAND = 8192.0f;
+
+/// 一个三角形被 6 个平面裁剪后最多 9 个顶点
+constexpr int MAX_CLIP_VERTS = 9;
+
+/// 每个顶点最多带多少个 float varying，见 shader.h
+constexpr int MAX_VARYINGS = 16;
+
+struct ClipSettings {
+    bool farPlane = false;  // 是否也按远平面裁剪，关闭时跨远平面的三角形照常画
+};
+
+/// 裁剪空间顶点，和需要插值的属性
+struct ClipVertex {
+    float x, y, z, w;
+    float varyings[MAX_VARYINGS];  // 只有前 nVaryings 个有效
+};
+
+/// 用 ClipBits 判断三角形是否要裁剪
+/// \param bits 三个顶点 ClipBits 的按位或
+inline bool needsClipping(unsigned char bits, const ClipSettings &settings) {
+    unsigned char mask = CLIP_NEAR | CLIP_GUARD | (settings.farPlane ? CLIP_FAR : 0);
+    return (bits & mask) != 0;
+}
+
+/// 按近平面、保护带（和可选的远平面）裁剪三角形，Sutherland-Hodgman
+/// \param in 三角形的三个顶点
+/// \param nVaryings 每个顶点有几个 varying，新顶点只插值这几个
+/// \param out 裁剪后的凸多边形，至少能放 MAX_CLIP_VERTS 个顶点
+/// \return out 的顶点数，小于 3 表示整个三角形被裁掉
+int clipTriangle(const ClipVertex *in, int nVaryings, const ScreenBounds &bounds, const ClipSettings &settings,
+                 ClipVertex *out);
+
+#endif //CLIP_H_
@@ -0,0 +1,18 @@
+﻿#include "cull.h"
+
+
+bool boxOutsideFrustum(const Mat4 &mvp, Vec3f bmin, Vec3f bmax, const ScreenBounds &bounds) {
+    const float(*m)[4] = mvp.m;
+    unsigned char common = (unsigned char)~CLIP_GUARD;
+    for (int i = 0; i < 8 && common; i++) {
+        float vx = i & 1 ? bmax.x : bmin.x;
+        float vy = i & 2 ? bmax.y : bmin.y;
+        float vz = i & 4 ? bmax.z : bmin.z;
+        float cx = m[0][0] * vx + m[0][1] * vy + m[0][2] * vz + m[0][3];
+        float cy = m[1][0] * vx + m[1][1] * vy + m[1][2] * vz + m[1][3];
+        float cz = m[2][0] * vx + m[2][1] * vy + m[2][2] * vz + m[2][3];
+        float cw = m[3][0] * vx + m[3][1] * vy + m[3][2] * vz + m[3][3];
+        common &= clipBits(cx / cw, cy / cw, cz / cw, cw, bounds);
+    }
+    return common != 0;
+}
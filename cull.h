@@ -0,0 +1,57 @@
+﻿#ifndef CULL_H_
+#define CULL_H_
+
+#include "GMath.h"
+#include "vertex.h"
+
+
+/*
+    光栅化之前的剔除
+    1. 物体：模型空间包围盒的 8 个角都在视锥同一个面外侧时，整个模型跳过，连顶点都不用变换
+    2. 视锥：三个顶点的 ClipBits 按位与不为 0（保护带那一位除外）
+    3. 背面：屏幕空间有向面积的符号和正面的绕序相反
+    4. 空三角形：退化，或者包围盒里没有任何像素中心，见 setupTriangle()
+    封闭网格大约一半三角形是背面，直接省掉这部分的 setup、分块和光栅化
+*/
+
+/// 正面的顶点绕序，按 y 轴向上的屏幕空间看
+enum class FrontFace { CounterClockwise, Clockwise };
+
+struct CullSettings {
+    bool backFace = true;  // 是否剔除背面
+    FrontFace frontFace = FrontFace::CounterClockwise;
+};
+
+/// 各项测试剔除的三角形个数
+struct CullStats {
+    long long input = 0;     // 提交的三角形
+    long long object = 0;    // 整个物体在视锥外
+    long long frustum = 0;
+    long long backFace = 0;
+    long long clipped = 0;   // 跨近平面或超出保护带、被裁剪的三角形，裁出的三角形另外计入后面几项
+    long long empty = 0;     // 退化或不覆盖任何像素中心
+    long long rasterized = 0;
+
+    CullStats &operator+=(const CullStats &o) {
+        input += o.input;
+        object += o.object;
+        frustum += o.frustum;
+        backFace += o.backFace;
+        clipped += o.clipped;
+        empty += o.empty;
+        rasterized += o.rasterized;
+        return *this;
+    }
+};
+
+/// 包围盒 [bmin, bmax] 变换后是否整个在视锥外
+/// \param mvp concatMVP 的结果
+bool boxOutsideFrustum(const Mat4 &mvp, Vec3f bmin, Vec3f bmax, const ScreenBounds &bounds);
+
+/// \param ccwArea 屏幕空间有向面积的两倍，逆时针为正
+inline bool isBackFace(float ccwArea, const CullSettings &settings) {
+    if (!settings.backFace) return false;
+    return settings.frontFace == FrontFace::CounterClockwise ? ccwArea < 0 : ccwArea > 0;
+}
+
+#endif //CULL_H_
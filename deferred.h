@@ -0,0 +1,182 @@
+﻿#ifndef DEFERRED_H_
+#define DEFERRED_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "GMath.h"
+#include "framebuffer.h"
+#include "gbuffer.h"
+#include "image.h"
+#include "model.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "render.h"
+#include "shader.h"
+#include "tgaimage.h"
+
+
+/*
+    延迟着色 (deferred shading)
+    前向渲染里每个通过深度测试的片元都要取纹理、算光照，被后画的三角形挡住的像素白算了，
+    开销随场景的重叠层数 (overdraw) 增长
+    延迟着色分两步：
+        1. drawModelGBuffer()：光栅化只写深度和 10 字节的 G-buffer (gbuffer.h)，片元阶段不取纹理
+        2. shadeGBuffer()：全屏着色，每个可见像素解码 G-buffer 后调用一次 Lighting::shade()，
+           按行切块在线程池上并行，本帧没画到的 tile 整块跳过
+    光照的开销只和分辨率、可见像素数有关，光源多、着色贵时才划算；只有一盏平行光时前向渲染更快
+    多个模型可以先各自 drawModelGBuffer()，最后只做一次 shadeGBuffer()
+
+    Lighting 是普通的类，提供：
+        TGAColor shade(const GBufferSample &sample) const
+    会在多个线程上同时调用
+*/
+
+
+/// 光栅化目标：fragment() 输出 GBufferTexel，material 为 0 的像素在着色阶段当作背景
+struct GBufferTarget {
+    ImageView<GBufferF> gbuffer;
+
+    template <class Shader>
+    bool shade(const Shader &shader, const typename Shader::Flat &flat, Varyings in, int x, int y) const {
+        return shader.fragment(flat, in, gbuffer.at(x, y));
+    }
+};
+
+
+/// 用着色器把网格画进 fb 的 G-buffer，参数同 drawMesh()
+/// \return fb 没有打开 G-buffer 时返回 false
+template <class Shader>
+bool drawMeshGBuffer(Framebuffer &fb, const Shader &shader, int nVerts, const int *faces, int nFaces,
+                     RenderState &state) {
+    if (!fb.hasGBuffer()) return false;
+    setupMesh(fb.width(), fb.height(), shader, nVerts, faces, nFaces, state);
+    flushMesh(GBufferTarget{fb.gbuffer()}, fb.depth(), &fb, shader, state);
+    return true;
+}
+
+/// 画整个模型，先用 shader.mvp() 和模型包围盒做整体的视锥剔除，同 drawModel()
+template <class Shader>
+bool drawModelGBuffer(Framebuffer &fb, Model *model, const Shader &shader, RenderState &state) {
+    if (!fb.hasGBuffer()) return false;
+    if (modelOutsideFrustum(fb.width(), fb.height(), model, shader, state)) return true;
+    return drawMeshGBuffer(fb, shader, model->nVert(), model->indices(), model->nFaces(), state);
+}
+
+
+/// 全屏着色的骨架：按行切块在线程池上并行，跳过本帧没画到的 tile，
+/// 对其余每个像素调用 fn(x, y, TGAColor &color)，返回 true 时把 color 写进颜色缓冲
+/// \return 颜色缓冲格式不支持时返回 false
+template <class Fn>
+bool shadeScreen(Framebuffer &fb, ThreadPool &pool, Fn &&fn) {
+    const int width = fb.width(), tilesX = fb.tilesX();
+    constexpr int TILE = Framebuffer::TILE;
+    return visitColorView(fb.color(), [&](auto color) {
+        using Format = typename decltype(color)::FormatType;
+        // 每块 TILE / 4 行，一个 tile 行分给 4 个任务，线程少时也能分得开
+        pool.parallelFor(0, fb.height(), [&](int y) {
+            auto *out = color.row(y);
+            const int tileRow = (y / TILE) * tilesX;
+            for (int tx = 0; tx < tilesX; tx++) {
+                if (!fb.drawn(tileRow + tx)) continue;
+                const int x1 = std::min((tx + 1) * TILE, width);
+                for (int x = tx * TILE; x < x1; x++) {
+                    TGAColor c;
+                    if (fn(x, y, c)) out[x] = Format::pack(c.r, c.g, c.b, c.a);
+                }
+            }
+        }, TILE / 4);
+    });
+}
+
+/// 全屏着色，把 G-buffer 中本帧画到的像素着色后写进颜色缓冲
+/// 在 drawModelGBuffer() 之后、fb.resolve() 之前调用
+/// \return fb 没有打开 G-buffer 或颜色缓冲格式不支持时返回 false
+template <class Lighting>
+bool shadeGBuffer(Framebuffer &fb, const Lighting &lighting, ThreadPool &pool) {
+    if (!fb.hasGBuffer()) return false;
+    const ImageView<GBufferF> gbuffer = fb.gbuffer();
+    const ImageView<DepthF32> depth = fb.depth().view();
+    return shadeScreen(fb, pool, [&](int x, int y, TGAColor &color) {
+        const GBufferTexel &t = gbuffer.at(x, y);
+        if (!t.material) return false;
+        color = lighting.shade(unpackGBuffer(t, x, y, depth.at(x, y)));
+        return true;
+    });
+}
+
+
+/*
+    把模型画进 G-buffer 的着色器：varyings 是纹理坐标和观察空间的顶点法线，透视矫正插值，
+    片元阶段只做打包，不取纹理；mip 层和 TextureShader 一样由纹理坐标的偏导每个 2x2 像素块算一次
+    法线用 modelView() 的左上 3x3 变换，模型矩阵只有旋转、平移和均匀缩放时成立
+*/
+class GBufferShader : public IShader<GBufferShader, 5> {
+public:
+    static constexpr int DERIVATIVES = 2;
+
+    /// \param material 写进 G-buffer 的材质编号，1..255，0 留给背景
+    explicit GBufferShader(Model *model, int material = 1) : model_(model), material_(material) {}
+
+    Vec4f vertex(int vert, float *varyings) const {
+        Vec2f uv = model_->uvs()[vert];
+        Vec4f n = modelView() * Vec4f(model_->normals()[vert], 0.f);
+        varyings[0] = uv.x;
+        varyings[1] = uv.y;
+        varyings[2] = n.x;
+        varyings[3] = n.y;
+        varyings[4] = n.z;
+        return mvp() * Vec4f(model_->verts()[vert], 1.f);
+    }
+
+    /// 插值后的法线不再是单位长度，八面体编码本身会归一化
+    bool fragment(const NoFlat &, Varyings in, GBufferTexel &out) const {
+        float lod = model_->diffuseLod(Vec2f(in.ddx(0), in.ddx(1)), Vec2f(in.ddy(0), in.ddy(1)));
+        out = packGBuffer(in[0], in[1], Vec3f(in[2], in[3], in[4]), lod, material_);
+        return true;
+    }
+
+private:
+    Model *model_;
+    int material_;
+};
+
+
+/*
+    漫反射 + 多盏平行光：
+        亮度 = ambient + Σ intensity_i * max(n · -dir_i, 0)
+    dir 是光线前进的方向，和 drawModel() 的 lightDir 含义相同，但在观察空间：(0, 0, -1) 是从相机射向物体的光
+    颜色 = 漫反射贴图 * 亮度，超过 255 截断；所有材质共用同一张贴图
+*/
+class DiffuseLighting {
+public:
+    explicit DiffuseLighting(const Model *model, float ambient = 0.1f) : model_(model), ambient_(ambient) {}
+
+    /// \param dir 光线方向，观察空间，不必是单位向量
+    void addLight(Vec3f dir, float intensity = 1.f) {
+        dir.normalize();
+        lights_.push_back({dir * -1.f, intensity});
+    }
+
+    [[nodiscard]] int nLights() const { return (int)lights_.size(); }
+
+    TGAColor shade(const GBufferSample &s) const {
+        float intensity = ambient_;
+        for (const Light &l : lights_) intensity += l.intensity * std::max(s.normal * l.toLight, 0.f);
+        TGAColor diffuse = model_->diffuse(s.uv.x, s.uv.y, s.lod);
+        auto scale = [&](unsigned char c) { return (unsigned char)std::min(c * intensity, 255.f); };
+        return TGAColor(scale(diffuse.r), scale(diffuse.g), scale(diffuse.b), 255);
+    }
+
+private:
+    struct Light {
+        Vec3f toLight;  // 指向光源的单位向量
+        float intensity;
+    };
+
+    const Model *model_;
+    float ambient_;
+    std::vector<Light> lights_;
+};
+
+#endif //DEFERRED_H_
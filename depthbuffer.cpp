@@ -0,0 +1,76 @@
+﻿#include "depthbuffer.h"
+
+#include <algorithm>
+#include <limits>
+
+
+void DepthBuffer::resize(int w, int h) {
+    width_ = w;
+    height_ = h;
+    blocksX_ = (w + BLOCK - 1) / BLOCK;
+    blocksY_ = (h + BLOCK - 1) / BLOCK;
+    coarseX_ = (w + COARSE - 1) / COARSE;
+    coarseY_ = (h + COARSE - 1) / COARSE;
+    z_.resize(w, h);
+    blockMin_.resize((size_t)blocksX_ * blocksY_);
+    blockMax_.resize(blockMin_.size());
+    coarseMin_.resize((size_t)coarseX_ * coarseY_);
+    clear();
+}
+
+
+void DepthBuffer::clear() {
+    const float far = -std::numeric_limits<float>::infinity();
+    z_.fill(far);
+    std::fill(blockMin_.begin(), blockMin_.end(), far);
+    std::fill(blockMax_.begin(), blockMax_.end(), far);
+    std::fill(coarseMin_.begin(), coarseMin_.end(), far);
+}
+
+
+void DepthBuffer::clearCoarse(int cx, int cy) {
+    const float far = -std::numeric_limits<float>::infinity();
+    int x0 = cx * COARSE, x1 = std::min(x0 + COARSE, width_);
+    int y0 = cy * COARSE, y1 = std::min(y0 + COARSE, height_);
+    z_.view().sub(x0, y0, x1 - x0, y1 - y0).fill(far);
+
+    int bx0 = cx * BLOCKS_PER_COARSE, bx1 = std::min(bx0 + BLOCKS_PER_COARSE, blocksX_);
+    int by0 = cy * BLOCKS_PER_COARSE, by1 = std::min(by0 + BLOCKS_PER_COARSE, blocksY_);
+    for (int j = by0; j < by1; j++) {
+        std::fill(blockMin_.begin() + bx0 + j * blocksX_, blockMin_.begin() + bx1 + j * blocksX_, far);
+        std::fill(blockMax_.begin() + bx0 + j * blocksX_, blockMax_.begin() + bx1 + j * blocksX_, far);
+    }
+    coarseMin_[cx + cy * coarseX_] = far;
+}
+
+
+void DepthBuffer::updateBlock(int bx, int by) {
+    int x0 = bx * BLOCK, x1 = std::min(x0 + BLOCK, width_);
+    int y0 = by * BLOCK, y1 = std::min(y0 + BLOCK, height_);
+    float lo = std::numeric_limits<float>::infinity();
+    float hi = -std::numeric_limits<float>::infinity();
+    for (int y = y0; y < y1; y++) {
+        const float *r = z_.row(y);
+        for (int x = x0; x < x1; x++) {
+            lo = std::min(lo, r[x]);
+            hi = std::max(hi, r[x]);
+        }
+    }
+
+    int b = bx + by * blocksX_;
+    float oldMin = blockMin_[b];
+    blockMin_[b] = lo;
+    blockMax_[b] = hi;
+
+    // 深度只会变近，块最小值只增不减；只有原来就是粗层最小值的块变了，粗层才需要重算
+    int cx = bx / BLOCKS_PER_COARSE, cy = by / BLOCKS_PER_COARSE;
+    float &coarse = coarseMin_[cx + cy * coarseX_];
+    if (oldMin > coarse || lo == oldMin) return;
+    int bx0 = cx * BLOCKS_PER_COARSE, bx1 = std::min(bx0 + BLOCKS_PER_COARSE, blocksX_);
+    int by0 = cy * BLOCKS_PER_COARSE, by1 = std::min(by0 + BLOCKS_PER_COARSE, blocksY_);
+    float m = std::numeric_limits<float>::infinity();
+    for (int j = by0; j < by1; j++)
+        for (int i = bx0; i < bx1; i++)
+            m = std::min(m, blockMin_[i + j * blocksX_]);
+    coarse = m;
+}
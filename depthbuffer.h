@@ -0,0 +1,70 @@
+﻿#ifndef DEPTHBUFFER_H_
+#define DEPTHBUFFER_H_
+
+#include <vector>
+
+#include "image.h"
+
+
+/*
+    带层次结构的深度缓冲 (Hierarchical Z)
+    除逐像素深度外，额外保存：
+        细层：每个 8x8 块内已写入深度的最小值/最大值
+        粗层：每个 64x64 块内的最小值，和 tile 对齐，各 tile 线程只改自己的那一块
+    深度越大越近，深度测试 z <= 已存深度 时丢弃，所以块内最小值就是最远的深度，
+    三角形在块内的最大深度都不超过它时，整块不用再做逐像素的工作
+*/
+/// 逐像素的深度测试
+/// Greater 只有更近的像素通过；GreaterEqual 深度相等也通过，先画过一遍深度 (z-prepass) 之后的着色 pass 用，
+/// 两遍算出的深度逐位相同，只有最前面的像素通过
+enum class DepthTest { Greater, GreaterEqual };
+
+class DepthBuffer {
+public:
+    static constexpr int BLOCK = 8;
+    static constexpr int COARSE = 64;
+    static constexpr int BLOCKS_PER_COARSE = COARSE / BLOCK;
+
+    DepthBuffer() = default;
+
+    DepthBuffer(int w, int h) { resize(w, h); }
+
+    void resize(int w, int h);
+
+    /// 所有深度置为 -inf
+    void clear();
+
+    /// 只清粗层块 (cx, cy)：块内深度、其中的 8x8 块和粗层最小值都置为 -inf
+    void clearCoarse(int cx, int cy);
+
+    [[nodiscard]] int width() const { return width_; }
+
+    [[nodiscard]] int height() const { return height_; }
+
+    float *data() { return z_.data(); }
+
+    const float *data() const { return z_.data(); }
+
+    float *row(int y) { return z_.row(y); }
+
+    ImageView<DepthF32> view() { return z_.view(); }
+
+    [[nodiscard]] float blockMin(int bx, int by) const { return blockMin_[bx + by * blocksX_]; }
+
+    [[nodiscard]] float blockMax(int bx, int by) const { return blockMax_[bx + by * blocksX_]; }
+
+    [[nodiscard]] float coarseMin(int cx, int cy) const { return coarseMin_[cx + cy * coarseX_]; }
+
+    /// 块内像素被写过之后重新统计该块的最小/最大深度，并更新所在粗层块
+    void updateBlock(int bx, int by);
+
+private:
+    int width_ = 0, height_ = 0;
+    int blocksX_ = 0, blocksY_ = 0;
+    int coarseX_ = 0, coarseY_ = 0;
+    Image<DepthF32> z_;
+    std::vector<float> blockMin_, blockMax_;
+    std::vector<float> coarseMin_;
+};
+
+#endif //DEPTHBUFFER_H_
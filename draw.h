@@ -2,7 +2,11 @@
 #define DRAW_H_
 
 #include "GMath.h"
+#include "image.h"
 #include "model.h"
+#include "pipeline.h"
+#include "raster.h"
+#include "shader.h"
 #include "tgaimage.h"
 
 
@@ -16,19 +20,9 @@ static Vec3f barycentric(const Vec3f *v, const Vec3f &point) {
     return {1.f - (u.x + u.y) / u.z, u.y / u.z, u.x / u.z};
 }
 
-static Vec2f interpolate(float alpha, float beta, float gamma, Vec2f &vert1,
-                         Vec2f &vert2, Vec2f &vert3, float weight = 1.0f) {
-    auto u = (alpha * vert1[0] + beta * vert2[0] + gamma * vert3[0]);
-    auto v = (alpha * vert1[1] + beta * vert2[1] + gamma * vert3[1]);
-    u /= weight;
-    v /= weight;
 
-    return {u, v};
-}
-
-
-
-void line(TGAImage &image, int x0, int y0, int x1, int y1, TGAColor color) {
+template <class Format>
+inline void line(ImageView<Format> image, int x0, int y0, int x1, int y1, typename Format::Pixel color) {
     bool steep = false;
     if (std::abs(x0 - x1) <
         std::abs(y0 - y1)) {  // if the line is steep, we transpose the image
@@ -45,8 +39,8 @@ void line(TGAImage &image, int x0, int y0, int x1, int y1, TGAColor color) {
     int derror2 = std::abs(dy) * 2, error2 = 0;
     int y = y0;
     for (int x = x0; x < x1; x++) {
-        if (steep) image.set(y, x, color);
-        else image.set(x, y, color);
+        int px = steep ? y : x, py = steep ? x : y;
+        if (image.contains(px, py)) image.at(px, py) = color;
 
         error2 += derror2;
         if (error2 > dx) {
@@ -58,74 +52,38 @@ void line(TGAImage &image, int x0, int y0, int x1, int y1, TGAColor color) {
 }
 
 
-void simpleTriangle(TGAImage &image, Vec3f *v) {
-    int width = image.get_width(), height = image.get_height();
-    int minX = (int)std::floor(min(v[0].x, v[1].x, v[2].x));
-    minX = std::max(minX, 0);
-    int maxX = (int)std::ceil(max(v[0].x, v[1].x, v[2].x));
-    maxX = std::min(maxX, width);
-    int minY = (int)std::floor(min(v[0].y, v[1].y, v[2].y));
-    minY = std::max(minY, 0);
-    int maxY = (int)std::ceil(max(v[0].y, v[1].y, v[2].y));
-    maxY = std::min(maxY, height);
-
-    Vec3f p;
-    for (int y = minY; y < maxY; y++) {
-        for (int x = minX; x < maxX; x++) {
-            p.x = (float)x + 0.5f;
-            p.y = (float)y + 0.5f;
-            p.z = 0.f;
-            Vec3f bc_screen = barycentric(v, p);  // 重心坐标
-            if (bc_screen.x < 0 || bc_screen.y < 0 || bc_screen.z < 0) continue;  // 像素超出三角形范围
-            image.set(x, y,TGAColor(0, 255, 255, 255));
-        }
-    }
+inline void line(TGAImage &image, int x0, int y0, int x1, int y1, TGAColor color) {
+    visitColorView(image, [&](auto view) {
+        using Format = typename decltype(view)::FormatType;
+        line(view, x0, y0, x1, y1, Format::fromColor(color));
+    });
 }
 
 
+inline void simpleTriangle(TGAImage &image, Vec3f *v) {
+    RasterTriangle tri;
+    if (!setupTriangle(v, image.get_width(), image.get_height(), tri)) return;
+    visitColorView(image, [&](auto view) {
+        using Format = typename decltype(view)::FormatType;
+        fillTriangle(view, tri, Format::fromColor(TGAColor(0, 255, 255, 255)));
+    });
+}
 
 
-
-void triangle(TGAImage &image, Model *model, float *zbuffer, Vec3f *v,
-              Vec2f *tri_uv, float intensity) {
-    // 超出屏幕的部分不绘制，裁剪操作
-    int width = image.get_width(), height = image.get_height();
-    int minX = (int)std::floor(min(v[0].x, v[1].x, v[2].x));
-    minX = std::max(minX, 0);
-    int maxX = (int)std::ceil(max(v[0].x, v[1].x, v[2].x));
-    maxX = std::min(maxX, width);
-    int minY = (int)std::floor(min(v[0].y, v[1].y, v[2].y));
-    minY = std::max(minY, 0);
-    int maxY = (int)std::ceil(max(v[0].y, v[1].y, v[2].y));
-    maxY = std::min(maxY, height);
-
-    Vec3f p;
-    Vec2f uv;
-    for (int y = minY; y < maxY; y++) {
-        for (int x = minX; x < maxX; x++) {
-            p.x = (float)x + 0.5f;
-            p.y = (float)y + 0.5f;
-            p.z = 0.f;
-            Vec3f bc_screen = barycentric(v, p);  // 重心坐标
-            if (bc_screen.x < 0 || bc_screen.y < 0 || bc_screen.z < 0)
-                continue;  // 像素超出三角形范围
-
-            // TODO 思考一下，这里是不是不需要裁剪了，不可能出现少一个面的情况
-            for (int i = 0; i < 3; i++) p.z += v[i].z * bc_screen[i];
-            // TODO 这里有没有做纹理的深度矫正
-            uv = interpolate(bc_screen.x, bc_screen.y, bc_screen.z, tri_uv[0],
-                             tri_uv[1], tri_uv[2]);
-
-            int idx = int(x + y * width);
-            if (p.z <= zbuffer[idx]) continue;  // 深度测试
-            zbuffer[idx] = p.z;
-            TGAColor diffuse = model->diffuse(uv.x, uv.y);
-            image.set(x, y,
-                      TGAColor((unsigned char)(intensity * diffuse.r),
-                               (unsigned char)(intensity * diffuse.g),
-                               (unsigned char)(intensity * diffuse.b), 255));
-        }
-    }
+inline void triangle(TGAImage &image, Model *model, DepthBuffer &depth, Vec3f *v,
+                     Vec2f *tri_uv, float intensity) {
+    // 超出屏幕的部分不绘制，裁剪操作在 setup 中对包围盒进行
+    RasterTriangle tri;
+    if (!setupTriangle(v, image.get_width(), image.get_height(), tri)) return;
+    // 单个三角形不经过顶点阶段，直接填 TextureShader 的着色数据；v 里没有 w，只能按仿射插值
+    ShadedTriangle<TextureShader> data;
+    float uv[3][2] = {{tri_uv[0].x, tri_uv[0].y}, {tri_uv[1].x, tri_uv[1].y}, {tri_uv[2].x, tri_uv[2].y}};
+    const float *vars[3] = {uv[0], uv[1], uv[2]};
+    const float invW[3] = {1.f, 1.f, 1.f};
+    setupPlanes(tri, vars, invW, data.planes);
+    data.flat = {intensity};
+    TextureShader shader(model, Vec3f(0, 0, -1));
+    visitColorView(image, [&](auto view) { rasterizeShaded(colorTarget(view), depth, tri, shader, data); });
 }
 
 #endif //DRAW_H_
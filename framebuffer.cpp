@@ -0,0 +1,87 @@
+﻿#include "framebuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+void Framebuffer::resize(int w, int h, int bytespp) {
+    width_ = w;
+    height_ = h;
+    bytespp_ = bytespp;
+    tilesX_ = (w + TILE - 1) / TILE;
+    tilesY_ = (h + TILE - 1) / TILE;
+    color_ = TGAImage(w, h, bytespp);  // 新分配的图像全为 0
+    depth_.resize(w, h);
+    gbuffer_ = hasGBuffer_ ? Image<GBufferF>(w, h) : Image<GBufferF>();
+    visibility_ = hasVisibility_ ? Image<Id32>(w, h) : Image<Id32>();
+    frame_ = 1;
+    tileFrame_.assign((size_t)tilesX_ * tilesY_, 0);
+    clean_.assign(tileFrame_.size(), 1);
+}
+
+
+void Framebuffer::clear() {
+    // 帧号回绕时所有 tile 的记录作废，保证不会和新帧号撞上
+    if (++frame_ == 0) {
+        std::fill(tileFrame_.begin(), tileFrame_.end(), 0);
+        frame_ = 1;
+    }
+}
+
+
+void Framebuffer::prepareTile(int tile) {
+    if (tileFrame_[tile] == frame_) return;
+    tileFrame_[tile] = frame_;
+    if (!clean_[tile]) clearTile(tile);
+    clean_[tile] = 0;
+}
+
+
+void Framebuffer::resolve() {
+    for (int t = 0; t < (int)tileFrame_.size(); t++) {
+        if (tileFrame_[t] == frame_ || clean_[t]) continue;
+        clearTile(t);
+        clean_[t] = 1;
+    }
+}
+
+
+void Framebuffer::setGBuffer(bool enabled) {
+    if (enabled == hasGBuffer_) return;
+    hasGBuffer_ = enabled;
+    // 新分配的 G-buffer 全为 0，和清屏值相同，tile 是否干净不受影响
+    gbuffer_ = enabled ? Image<GBufferF>(width_, height_) : Image<GBufferF>();
+}
+
+
+void Framebuffer::setVisibility(bool enabled) {
+    if (enabled == hasVisibility_) return;
+    hasVisibility_ = enabled;
+    visibility_ = enabled ? Image<Id32>(width_, height_) : Image<Id32>();
+}
+
+
+TGAImage Framebuffer::swapColor(TGAImage &&replacement) {
+    TGAImage old = std::move(color_);
+    color_ = std::move(replacement);
+    // 深度不受影响，但颜色内容未知，所有 tile 都要重新清
+    std::fill(clean_.begin(), clean_.end(), 0);
+    return old;
+}
+
+
+void Framebuffer::clearTile(int tile) {
+    int tx = tile % tilesX_, ty = tile / tilesX_;
+    int x0 = tx * TILE, x1 = std::min(x0 + TILE, width_);
+    int y0 = ty * TILE, y1 = std::min(y0 + TILE, height_);
+    size_t rowBytes = (size_t)(x1 - x0) * bytespp_;
+    unsigned char *base = color_.buffer();
+    for (int y = y0; y < y1; y++) memset(base + ((size_t)y * width_ + x0) * bytespp_, 0, rowBytes);
+    if (hasGBuffer_) {
+        for (int y = y0; y < y1; y++) memset(gbuffer_.row(y) + x0, 0, (size_t)(x1 - x0) * sizeof(GBufferTexel));
+    }
+    if (hasVisibility_) {
+        for (int y = y0; y < y1; y++) memset(visibility_.row(y) + x0, 0, (size_t)(x1 - x0) * sizeof(uint32_t));
+    }
+    depth_.clearCoarse(tx, ty);
+}
@@ -0,0 +1,97 @@
+﻿#ifndef FRAMEBUFFER_H_
+#define FRAMEBUFFER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "depthbuffer.h"
+#include "gbuffer.h"
+#include "image.h"
+#include "tgaimage.h"
+
+
+/*
+    颜色缓冲 + 深度缓冲，按 64x64 的 tile 延迟清屏
+    clear() 只把帧号加一，不碰像素
+    每个 tile 记录最近一次被画到的帧号，以及内容是否已经是清屏值：
+        1. 光栅化前 prepareTile() 发现 tile 本帧还没画过且内容不干净，才真正清掉这一块，
+           此时这块正要被写，清完还在缓存里
+        2. resolve() 把本帧没画到、但留有上一次内容的 tile 清掉
+    连续几帧都没画到的 tile 一次也不会再写，小物体输出到大分辨率时清屏开销只和画到的面积有关
+    真正要清的区域逐行 memset / std::fill，由库和编译器向量化
+    延迟着色时还可以挂一个 G-buffer (deferred.h)，可见性缓冲模式挂一个三角形编号缓冲 (visibility.h)，
+    都和颜色、深度一起按 tile 清
+*/
+class Framebuffer {
+public:
+    static constexpr int TILE = DepthBuffer::COARSE;
+
+    Framebuffer() = default;
+
+    Framebuffer(int w, int h, int bytespp = TGAImage::RGB) { resize(w, h, bytespp); }
+
+    /// 重新分配两个缓冲，内容清空
+    void resize(int w, int h, int bytespp = TGAImage::RGB);
+
+    /// 开始新的一帧，O(1)，颜色清成 0，深度清成 -inf
+    void clear();
+
+    /// tile 本帧第一次被写之前调用，必要时清掉这一块；不同线程只能处理不同的 tile
+    /// \param tile tile 下标 tx + ty * tilesX()
+    void prepareTile(int tile);
+
+    /// 清掉本帧没画到的旧内容，之后 color() 和 depth() 才是完整的一帧
+    void resolve();
+
+    /// 打开或关掉 G-buffer，打开时按当前尺寸分配，之后 resize() 也会一起分配
+    void setGBuffer(bool enabled);
+
+    [[nodiscard]] bool hasGBuffer() const { return hasGBuffer_; }
+
+    /// 没有打开 G-buffer 时为空视图
+    ImageView<GBufferF> gbuffer() { return gbuffer_.view(); }
+
+    /// 打开或关掉可见性缓冲，每个像素一个 32 位的实例/三角形编号，0 表示没有画到
+    void setVisibility(bool enabled);
+
+    [[nodiscard]] bool hasVisibility() const { return hasVisibility_; }
+
+    /// 没有打开可见性缓冲时为空视图
+    ImageView<Id32> visibility() { return visibility_.view(); }
+
+    /// tile 本帧是否被画过，没画过的 tile 内容都是清屏值
+    [[nodiscard]] bool drawn(int tile) const { return tileFrame_[tile] == frame_; }
+
+    /// 换出颜色缓冲（例如交给 FrameWriter），换入的图像尺寸格式必须相同，内容视为未知
+    /// \return 原来的颜色缓冲
+    TGAImage swapColor(TGAImage &&replacement);
+
+    TGAImage &color() { return color_; }
+
+    DepthBuffer &depth() { return depth_; }
+
+    [[nodiscard]] int width() const { return width_; }
+
+    [[nodiscard]] int height() const { return height_; }
+
+    [[nodiscard]] int tilesX() const { return tilesX_; }
+
+    [[nodiscard]] int tilesY() const { return tilesY_; }
+
+private:
+    void clearTile(int tile);
+
+    TGAImage color_;
+    DepthBuffer depth_;
+    Image<GBufferF> gbuffer_;
+    bool hasGBuffer_ = false;
+    Image<Id32> visibility_;
+    bool hasVisibility_ = false;
+    int width_ = 0, height_ = 0, bytespp_ = 0;
+    int tilesX_ = 0, tilesY_ = 0;
+    uint32_t frame_ = 1;
+    std::vector<uint32_t> tileFrame_;    // tile 最近一次被画到的帧号，0 表示从未画过
+    std::vector<unsigned char> clean_;   // tile 内容是否等于清屏值
+};
+
+#endif //FRAMEBUFFER_H_
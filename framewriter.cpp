@@ -0,0 +1,91 @@
+﻿#include "framewriter.h"
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+
+FrameWriter::FrameWriter(int nThreads, int maxQueued) : maxQueued_(std::max(maxQueued, 1)) {
+    nThreads = std::max(nThreads, 1);
+    for (int i = 0; i < nThreads; i++) workers_.emplace_back(&FrameWriter::workerLoop, this);
+}
+
+FrameWriter::~FrameWriter() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    hasJob_.notify_all();
+    for (auto &t : workers_) t.join();
+}
+
+
+void FrameWriter::submit(TGAImage &&image, std::string filename, bool rle, bool bottomUp) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        hasRoom_.wait(lock, [&] { return (int)jobs_.size() < maxQueued_; });
+        jobs_.push_back({std::move(image), std::move(filename), rle, bottomUp});
+    }
+    hasJob_.notify_one();
+}
+
+
+TGAImage FrameWriter::acquire(int w, int h, int bpp) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = free_.begin(); it != free_.end(); ++it) {
+            if (it->get_width() == w && it->get_height() == h && it->get_bytespp() == bpp) {
+                TGAImage image = std::move(*it);
+                free_.erase(it);
+                return image;
+            }
+        }
+    }
+    return TGAImage(w, h, bpp);
+}
+
+
+void FrameWriter::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    hasRoom_.wait(lock, [&] { return jobs_.empty() && busy_ == 0; });
+}
+
+
+int FrameWriter::failed() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return failed_;
+}
+
+
+void FrameWriter::workerLoop() {
+    std::vector<unsigned char> buf;  // 编码缓冲，跨帧复用
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            hasJob_.wait(lock, [&] { return stop_ || !jobs_.empty(); });
+            if (jobs_.empty()) return;
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+            busy_++;
+        }
+        hasRoom_.notify_all();
+
+        // 编码整个文件后一次写出
+        job.image.encode(buf, job.rle, job.bottomUp);
+        std::ofstream out(job.filename, std::ios::binary);
+        out.write((const char *)buf.data(), (std::streamsize)buf.size());
+        bool ok = out.good();
+        out.close();
+        if (!ok) std::cerr << "can't write frame " << job.filename << "\n";
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            busy_--;
+            if (!ok) failed_++;
+            if ((int)free_.size() < maxQueued_) free_.push_back(std::move(job.image));
+        }
+        hasRoom_.notify_all();
+    }
+}
@@ -0,0 +1,66 @@
+﻿#ifndef FRAMEWRITER_H_
+#define FRAMEWRITER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tgaimage.h"
+
+
+/*
+    异步输出帧
+    渲染线程把画好的帧移交 (move) 进队列后立刻继续下一帧，后台线程负责 RLE 编码和写盘
+    队列有上限，写盘跟不上时 submit() 阻塞，避免帧堆积占满内存
+    写完的图像留着给 acquire() 复用，每帧不用重新分配颜色缓冲
+*/
+class FrameWriter {
+public:
+    /// \param nThreads 后台线程数，<= 0 时取 1
+    /// \param maxQueued 排队等待写盘的最大帧数
+    explicit FrameWriter(int nThreads = 1, int maxQueued = 4);
+
+    ~FrameWriter();
+
+    FrameWriter(const FrameWriter &) = delete;
+    FrameWriter &operator=(const FrameWriter &) = delete;
+
+    /// 提交一帧，image 移交给写线程
+    /// \param bottomUp 第 0 行是最下面一行，见 TGAImage::write_tga_file
+    void submit(TGAImage &&image, std::string filename, bool rle = true, bool bottomUp = false);
+
+    /// 取一张写完回收的图像，没有尺寸合适的就新建，内容未清空
+    TGAImage acquire(int w, int h, int bpp);
+
+    /// 阻塞到队列中所有帧都写完
+    void wait();
+
+    /// 写失败的帧数
+    [[nodiscard]] int failed();
+
+private:
+    struct Job {
+        TGAImage image;
+        std::string filename;
+        bool rle;
+        bool bottomUp;
+    };
+
+    void workerLoop();
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable hasJob_;   // 队列非空或要退出
+    std::condition_variable hasRoom_;  // 队列有空位或全部写完
+    std::deque<Job> jobs_;
+    std::vector<TGAImage> free_;       // 写完等待复用的图像
+    int maxQueued_;
+    int busy_ = 0;                     // 正在写的帧数
+    int failed_ = 0;
+    bool stop_ = false;
+};
+
+#endif //FRAMEWRITER_H_
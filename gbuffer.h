@@ -0,0 +1,101 @@
+﻿#ifndef GBUFFER_H_
+#define GBUFFER_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "GMath.h"
+
+
+/*
+    延迟着色用的 G-buffer，每个像素 10 字节：
+        纹理坐标       2 x unorm16，截断到 [0, 1]，纹理采样本来就不重复 (clamp)
+        法线           观察空间的单位法线，八面体映射 (octahedral) 成 2 x snorm16
+        material      材质编号，0 表示这一帧没有画到
+        lod           纹理 mip 层，4 位整数 + 4 位小数
+    光栅化阶段只写深度和这 10 字节，不取纹理也不算光照；光照在之后的全屏着色阶段对每个可见像素只算一次
+*/
+struct GBufferTexel {
+    uint16_t u, v;
+    int16_t nx, ny;
+    uint8_t material;
+    uint8_t lod;
+};
+
+static_assert(sizeof(GBufferTexel) == 10, "G-buffer texels must be tightly packed");
+
+/// Image/ImageView 的像素格式，不对应 TGA 格式
+struct GBufferF {
+    using Pixel = GBufferTexel;
+    static constexpr int bytespp = sizeof(GBufferTexel);
+};
+
+
+/// 解码后的 G-buffer 像素，交给 Lighting::shade()
+struct GBufferSample {
+    int x, y;       // 屏幕坐标
+    float depth;    // 深度缓冲中的值，越大越近
+    Vec2f uv;
+    Vec3f normal;   // 观察空间单位法线
+    float lod;
+    int material;
+};
+
+
+inline uint16_t packUnorm16(float v) { return (uint16_t)std::lround(std::clamp(v, 0.f, 1.f) * 65535.f); }
+
+inline float unpackUnorm16(uint16_t v) { return (float)v * (1.f / 65535.f); }
+
+inline int16_t packSnorm16(float v) { return (int16_t)std::lround(std::clamp(v, -1.f, 1.f) * 32767.f); }
+
+inline float unpackSnorm16(int16_t v) { return std::max((float)v * (1.f / 32767.f), -1.f); }
+
+inline float signNotZero(float v) { return v >= 0.f ? 1.f : -1.f; }
+
+/// 单位向量投影到八面体 |x| + |y| + |z| = 1 上，再把下半部分翻折到正方形的四个角
+inline void encodeNormal(Vec3f n, int16_t &x, int16_t &y) {
+    float s = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (!(s > 0.f)) {
+        x = y = 0;  // 退化的法线按朝向相机 (0, 0, 1) 存
+        return;
+    }
+    float px = n.x / s, py = n.y / s;
+    if (n.z < 0.f) {
+        float fx = (1.f - std::abs(py)) * signNotZero(px);
+        float fy = (1.f - std::abs(px)) * signNotZero(py);
+        px = fx;
+        py = fy;
+    }
+    x = packSnorm16(px);
+    y = packSnorm16(py);
+}
+
+inline Vec3f decodeNormal(int16_t x, int16_t y) {
+    Vec3f n(unpackSnorm16(x), unpackSnorm16(y), 0.f);
+    n.z = 1.f - std::abs(n.x) - std::abs(n.y);
+    if (n.z < 0.f) {
+        float fx = (1.f - std::abs(n.y)) * signNotZero(n.x);
+        float fy = (1.f - std::abs(n.x)) * signNotZero(n.y);
+        n.x = fx;
+        n.y = fy;
+    }
+    return n.normalize();
+}
+
+inline GBufferTexel packGBuffer(float u, float v, Vec3f normal, float lod, int material) {
+    GBufferTexel t;
+    t.u = packUnorm16(u);
+    t.v = packUnorm16(v);
+    encodeNormal(normal, t.nx, t.ny);
+    t.material = (uint8_t)material;
+    t.lod = (uint8_t)std::lround(std::clamp(lod, 0.f, 15.9375f) * 16.f);
+    return t;
+}
+
+inline GBufferSample unpackGBuffer(const GBufferTexel &t, int x, int y, float depth) {
+    return {x, y, depth, Vec2f(unpackUnorm16(t.u), unpackUnorm16(t.v)), decodeNormal(t.nx, t.ny),
+            (float)t.lod * (1.f / 16.f), t.material};
+}
+
+#endif //GBUFFER_H_
@@ -0,0 +1,337 @@
+﻿#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "framebuffer.h"
+#include "framewriter.h"
+#include "model.h"
+#include "mvp.h"
+#include "raster.h"
+#include "render.h"
+#include "shadow.h"
+#include "tgaimage.h"
+#include "visibility.h"
+
+/*
+    无窗口批量渲染，不依赖 opencv，用于渲染农场节点上测帧率
+    用法: CPU_Render_Headless [-n frames] [-w width] [-h height] [-o output.tga] [-q] [-s] [-t threads] [-C] [-O] [-f filter] [-c cull] [-F] [-m mode] [-S pcf] [-Z] [-d dir] [obj] [diffuse.tga]
+*/
+
+enum class ShadingMode { Forward, Deferred, Visibility, Depth };
+
+struct Options {
+    int frames = 360;
+    int width = 800;
+    int height = 800;
+    std::string obj = "../assets/obj/african_head.obj";
+    std::string diffuse = "../assets/obj/african_head_diffuse.tga";
+    std::string output = "../image/headless.tga";
+    bool verbose = true;
+    bool scalar = false;
+    int threads = 0;
+    bool meshCache = true;
+    bool optimizeMesh = false;
+    TextureFilter filter = TextureFilter::Trilinear;
+    CullSettings cull;
+    ClipSettings clip;
+    std::string frameDir;  // 非空时每一帧都写到这个目录
+    ShadingMode mode = ShadingMode::Forward;
+    int shadowPcf = -1;          // >= 0 时打开阴影，PCF 半径
+    bool depthPrepass = false;
+};
+
+static void usage(const char *exe) {
+    std::fprintf(stderr,
+                 "usage: %s [-n frames] [-w width] [-h height] [-o output.tga] [-q] [-s] [-t threads] [-C] [-O] [-f filter] [-c cull] [-F] [-m mode] [-S pcf] [-Z] [-d dir] [obj] [diffuse.tga]\n"
+                 "  -n  number of turntable frames (default 360, one degree per frame)\n"
+                 "  -o  write the last frame to this file, \"-\" to skip\n"
+                 "  -q  only print the summary, not every frame\n"
+                 "  -s  force the scalar rasterizer even if the CPU supports SIMD\n"
+                 "  -t  rasterizer threads (default: all hardware threads)\n"
+                 "  -C  don't read or write the binary mesh cache (obj + \".cache\")\n"
+                 "  -O  reorder triangles and vertices for vertex reuse after loading\n"
+                 "  -f  texture filter: nearest, bilinear or trilinear (default)\n"
+                 "  -c  back-face culling: ccw (default, counter-clockwise faces are front), cw or none\n"
+                 "  -F  clip triangles against the far plane too (the near plane is always clipped)\n"
+                 "  -m  shading: forward (default), deferred (G-buffer, then one full-screen lighting pass)\n"
+                 "      visibility (triangle IDs, then a full-screen pass that rebuilds attributes and shades)\n"
+                 "      or depth (depth-only pass, the last frame is written as a grayscale depth image)\n"
+                 "  -S  forward shading with a shadow map, PCF over (2 * pcf + 1)^2 texels, 0 for hard shadows\n"
+                 "  -Z  forward shading with a depth-only pre-pass, so only the front-most fragments are shaded\n"
+                 "  -d  write every frame to dir/frame_NNNN.tga on a background thread\n",
+                 exe);
+}
+
+static const char *filterName(TextureFilter filter) {
+    switch (filter) {
+        case TextureFilter::Nearest: return "nearest";
+        case TextureFilter::Bilinear: return "bilinear";
+        default: return "trilinear";
+    }
+}
+
+static bool parseFilter(const char *name, TextureFilter &filter) {
+    for (TextureFilter f : {TextureFilter::Nearest, TextureFilter::Bilinear, TextureFilter::Trilinear}) {
+        if (!std::strcmp(name, filterName(f))) {
+            filter = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parseCull(const char *name, CullSettings &cull) {
+    if (!std::strcmp(name, "none")) {
+        cull.backFace = false;
+        return true;
+    }
+    cull.backFace = true;
+    if (!std::strcmp(name, "ccw")) cull.frontFace = FrontFace::CounterClockwise;
+    else if (!std::strcmp(name, "cw")) cull.frontFace = FrontFace::Clockwise;
+    else return false;
+    return true;
+}
+
+static const char *cullName(const CullSettings &cull) {
+    if (!cull.backFace) return "none";
+    return cull.frontFace == FrontFace::CounterClockwise ? "ccw" : "cw";
+}
+
+static const char *modeName(ShadingMode mode) {
+    switch (mode) {
+        case ShadingMode::Deferred: return "deferred";
+        case ShadingMode::Visibility: return "visibility";
+        case ShadingMode::Depth: return "depth";
+        default: return "forward";
+    }
+}
+
+static bool parseMode(const char *name, ShadingMode &mode) {
+    for (ShadingMode m : {ShadingMode::Forward, ShadingMode::Deferred, ShadingMode::Visibility, ShadingMode::Depth}) {
+        if (!std::strcmp(name, modeName(m))) {
+            mode = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// 深度缓冲转成灰度图，画到的像素按本帧的深度范围拉伸到 [32, 255]，越近越亮，没画到的像素为黑
+/// 透视投影下的深度集中在很窄的范围里，直接当灰度几乎看不出差别
+static TGAImage depthImage(DepthBuffer &depth) {
+    float lo = std::numeric_limits<float>::infinity(), hi = -lo;
+    for (int y = 0; y < depth.height(); y++) {
+        const float *z = depth.row(y);
+        for (int x = 0; x < depth.width(); x++) {
+            if (!std::isfinite(z[x])) continue;
+            lo = std::min(lo, z[x]);
+            hi = std::max(hi, z[x]);
+        }
+    }
+    const float scale = hi > lo ? 223.f / (hi - lo) : 0.f;
+    TGAImage image(depth.width(), depth.height(), TGAImage::GRAYSCALE);
+    ImageView<Gray8> out = imageView<Gray8>(image);
+    for (int y = 0; y < depth.height(); y++) {
+        const float *z = depth.row(y);
+        for (int x = 0; x < depth.width(); x++)
+            out.at(x, y) = std::isfinite(z[x]) ? (unsigned char)(255.f - (hi - z[x]) * scale) : 0;
+    }
+    return image;
+}
+
+
+static bool parseArgs(int argc, char **argv, Options &opt) {
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!std::strcmp(arg, "-n") && hasValue) opt.frames = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "-w") && hasValue) opt.width = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "-h") && hasValue) opt.height = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "-o") && hasValue) opt.output = argv[++i];
+        else if (!std::strcmp(arg, "-d") && hasValue) opt.frameDir = argv[++i];
+        else if (!std::strcmp(arg, "-t") && hasValue) opt.threads = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "-q")) opt.verbose = false;
+        else if (!std::strcmp(arg, "-s")) opt.scalar = true;
+        else if (!std::strcmp(arg, "-C")) opt.meshCache = false;
+        else if (!std::strcmp(arg, "-O")) opt.optimizeMesh = true;
+        else if (!std::strcmp(arg, "-F")) opt.clip.farPlane = true;
+        else if (!std::strcmp(arg, "-Z")) opt.depthPrepass = true;
+        else if (!std::strcmp(arg, "-S") && hasValue) opt.shadowPcf = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "-f") && hasValue) { if (!parseFilter(argv[++i], opt.filter)) return false; }
+        else if (!std::strcmp(arg, "-c") && hasValue) { if (!parseCull(argv[++i], opt.cull)) return false; }
+        else if (!std::strcmp(arg, "-m") && hasValue) { if (!parseMode(argv[++i], opt.mode)) return false; }
+        else if (arg[0] != '-' && positional == 0) { opt.obj = arg; positional++; }
+        else if (arg[0] != '-' && positional == 1) { opt.diffuse = arg; positional++; }
+        else return false;
+    }
+    // 阴影和深度预渲染只加在前向渲染上
+    if ((opt.shadowPcf >= 0 || opt.depthPrepass) && opt.mode != ShadingMode::Forward) return false;
+    return opt.frames > 0 && opt.width > 0 && opt.height > 0;
+}
+
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    using clock = std::chrono::steady_clock;
+    auto loadStart = clock::now();
+    Model *model = new Model(opt.obj.c_str(), opt.diffuse.c_str(), opt.meshCache);
+    double loadMs = std::chrono::duration<double, std::milli>(clock::now() - loadStart).count();
+    if (model->nFaces() == 0) {
+        std::fprintf(stderr, "nothing to render in %s\n", opt.obj.c_str());
+        delete model;
+        return 1;
+    }
+
+    model->setTextureFilter(opt.filter);
+
+    MeshOptStats meshStats;
+    double optimizeMs = 0;
+    if (opt.optimizeMesh) {
+        auto optStart = clock::now();
+        meshStats = model->optimizeVertexOrder();
+        optimizeMs = std::chrono::duration<double, std::milli>(clock::now() - optStart).count();
+    }
+
+    if (opt.scalar) setRasterPath(RasterPath::Scalar);
+
+    const int width = opt.width, height = opt.height;
+    Framebuffer fb(width, height, TGAImage::RGB);
+    fb.setGBuffer(opt.mode == ShadingMode::Deferred);
+    fb.setVisibility(opt.mode == ShadingMode::Visibility);
+    RenderState state(opt.threads);
+    state.cull = opt.cull;
+    state.clip = opt.clip;
+    state.depthPrepass = opt.depthPrepass;
+    CullStats cullTotal;
+
+    // 平行光从左上前方照过来，阴影区域是模型绕 y 轴转动时扫过的球
+    ShadowMap shadow;
+    if (opt.shadowPcf >= 0) {
+        Vec3f lo = model->bboxMin(), hi = model->bboxMax();
+        Vec3f extent(std::max(-lo.x, hi.x), std::max(-lo.y, hi.y), std::max(-lo.z, hi.z));
+        shadow.setDirectional(Vec3f(1, -1, -1), Vec3f(0, 0, 0), extent.norm());
+        shadow.pcfRadius = opt.shadowPcf;
+    }
+
+    Vec3f camera(0, 0, 3);
+    Vec3f target(0, 0, 0);
+    Vec3f up(0, 1, 0);
+    Mat4 viewportM = viewport(0, 0, width, height);
+    Mat4 viewM = lookAt(camera, target, up);
+    Mat4 projM = projection(45, (float)width / (float)height, 0.1f, 50.0f);
+
+    // 逐帧输出在后台线程编码写盘，渲染线程只移交图像
+    std::unique_ptr<FrameWriter> writer;
+    if (!opt.frameDir.empty()) writer = std::make_unique<FrameWriter>();
+
+    std::vector<double> frameMs(opt.frames);
+    double shadowMs = 0;
+    float angle = 0.0f;
+    float step = 360.0f / (float)opt.frames;
+    auto runStart = clock::now();
+    for (int f = 0; f < opt.frames; f++) {
+        auto t0 = clock::now();
+        fb.clear();
+        Mat4 modelM = modelMatrix(angle, {0, 1, 0});
+        if (opt.shadowPcf >= 0) {
+            auto s0 = clock::now();
+            shadow.clear();
+            shadow.render(model, modelM, state);
+            shadowMs += std::chrono::duration<double, std::milli>(clock::now() - s0).count();
+        }
+        switch (opt.mode) {
+            case ShadingMode::Deferred:
+                drawModelDeferred(fb, model, state, modelM, viewM, projM, viewportM);
+                break;
+            case ShadingMode::Visibility:
+                drawModelVisibility(fb, model, state, modelM, viewM, projM, viewportM);
+                break;
+            case ShadingMode::Depth:
+                drawModelDepth(fb, model, state, modelM, viewM, projM, viewportM);
+                break;
+            default:
+                if (opt.shadowPcf >= 0) drawModelShadowed(fb, model, shadow, state, modelM, viewM, projM, viewportM);
+                else drawModel(fb, model, state, modelM, viewM, projM, viewportM);
+                break;
+        }
+        fb.resolve();
+        auto t1 = clock::now();
+        cullTotal += state.cullStats;
+
+        frameMs[f] = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        if (opt.verbose) std::printf("frame %4d  %8.3f ms\n", f, frameMs[f]);
+        angle += step;
+
+        if (writer) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/frame_%04d.tga", f);
+            // 最后一帧还要留给 -o
+            if (f + 1 < opt.frames) {
+                writer->submit(fb.swapColor(writer->acquire(width, height, TGAImage::RGB)), opt.frameDir + name,
+                               true, true);
+            } else {
+                writer->submit(TGAImage(fb.color()), opt.frameDir + name, true, true);
+            }
+        }
+    }
+    if (writer) writer->wait();
+    double wallMs = std::chrono::duration<double, std::milli>(clock::now() - runStart).count();
+
+    double total = 0;
+    for (double ms : frameMs) total += ms;
+    std::vector<double> sorted = frameMs;
+    std::sort(sorted.begin(), sorted.end());
+    auto p99Idx = (size_t)std::ceil(0.99 * (double)sorted.size()) - 1;
+    double mean = total / (double)opt.frames;
+    double trisPerSec = (double)model->nFaces() * opt.frames / (total / 1000.0);
+
+    std::printf("frames        %d (%dx%d, %d triangles)\n", opt.frames, width, height, model->nFaces());
+    std::printf("load          %.3f ms%s\n", loadMs, opt.meshCache ? "" : " (no mesh cache)");
+    if (opt.optimizeMesh)
+        std::printf("mesh opt      %.3f ms, ACMR %.3f -> %.3f (FIFO %d)\n", optimizeMs, meshStats.acmrBefore,
+                    meshStats.acmrAfter, MESH_OPT_CACHE_SIZE);
+    std::printf("rasterizer    %s, %d threads\n", rasterPathName(activeRasterPath()), state.pool.nThreads());
+    std::printf("shading       %s%s\n", modeName(opt.mode), opt.depthPrepass ? ", depth pre-pass" : "");
+    if (opt.shadowPcf >= 0)
+        std::printf("shadows       %dx%d map, PCF %dx%d, %.3f ms per frame\n", shadow.size(), shadow.size(),
+                    2 * opt.shadowPcf + 1, 2 * opt.shadowPcf + 1, shadowMs / opt.frames);
+    std::printf("texture       %s, %d mip levels\n", filterName(opt.filter), model->diffuseTexture().nLevels());
+    auto perFrame = [&](long long n) { return (double)n / opt.frames; };
+    std::printf("culling       back faces %s, per frame: object %.0f, frustum %.0f, back %.0f, empty %.0f, "
+                "clipped %.0f, rasterized %.0f\n",
+                cullName(opt.cull), perFrame(cullTotal.object), perFrame(cullTotal.frustum),
+                perFrame(cullTotal.backFace), perFrame(cullTotal.empty), perFrame(cullTotal.clipped),
+                perFrame(cullTotal.rasterized));
+    std::printf("mean          %.3f ms (%.1f fps)\n", mean, 1000.0 / mean);
+    std::printf("min / max     %.3f / %.3f ms\n", sorted.front(), sorted.back());
+    std::printf("p99           %.3f ms\n", sorted[p99Idx]);
+    std::printf("triangles/s   %.3e\n", trisPerSec);
+    std::printf("wall          %.3f ms%s\n", wallMs, writer ? " (including frame output)" : "");
+    PickResult hit;
+    if (opt.mode == ShadingMode::Visibility && pick(fb, width / 2, height / 2, hit))
+        std::printf("pick          (%d, %d): instance %d, triangle %d, depth %.3f\n", width / 2, height / 2,
+                    hit.instance, hit.triangle, hit.depth);
+    if (writer && writer->failed()) std::printf("failed writes %d\n", writer->failed());
+
+    if (opt.output != "-") {
+        // 原点放到左下角，和窗口程序输出一致
+        if (opt.mode == ShadingMode::Depth) depthImage(fb.depth()).write_tga_file(opt.output.c_str(), true, true);
+        else fb.color().write_tga_file(opt.output.c_str(), true, true);
+    }
+
+    delete model;
+    return 0;
+}
@@ -0,0 +1,179 @@
+﻿#ifndef IMAGE_H_
+#define IMAGE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "tgaimage.h"
+
+
+/*
+    编译期确定像素格式的图像
+    TGAImage 的 get/set 每次都要检查边界、按运行时的 bytespp 逐字节拷贝，内层循环里开销很大
+    这里像素格式是模板参数，行指针和 at() 不检查边界，写一个像素就是一次定长的存储
+    TGAImage 仍负责读写文件，内层循环通过 imageView() 直接访问它的缓冲
+*/
+
+/// 灰度
+struct Gray8 {
+    using Pixel = unsigned char;
+    static constexpr int bytespp = TGAImage::GRAYSCALE;
+
+    static Pixel pack(unsigned char r, unsigned char g, unsigned char b, unsigned char = 255) {
+        return (unsigned char)((r * 77 + g * 150 + b * 29) >> 8);
+    }
+
+    static Pixel fromColor(const TGAColor &c) { return c.raw[0]; }
+};
+
+/// 3 字节 BGR，和 TGA 文件中的顺序相同
+struct RGB8 {
+    struct Pixel {
+        unsigned char b, g, r;
+    };
+    static constexpr int bytespp = TGAImage::RGB;
+
+    static Pixel pack(unsigned char r, unsigned char g, unsigned char b, unsigned char = 255) { return {b, g, r}; }
+
+    static Pixel fromColor(const TGAColor &c) { return {c.b, c.g, c.r}; }
+};
+
+/// 4 字节 BGRA
+struct RGBA8 {
+    struct Pixel {
+        unsigned char b, g, r, a;
+    };
+    static constexpr int bytespp = TGAImage::RGBA;
+
+    static Pixel pack(unsigned char r, unsigned char g, unsigned char b, unsigned char a = 255) {
+        return {b, g, r, a};
+    }
+
+    static Pixel fromColor(const TGAColor &c) { return {c.b, c.g, c.r, c.a}; }
+};
+
+/// 32 位浮点深度，不对应 TGA 格式
+struct DepthF32 {
+    using Pixel = float;
+    static constexpr int bytespp = 4;
+};
+
+/// 32 位整数编号，可见性缓冲用，不对应 TGA 格式
+struct Id32 {
+    using Pixel = uint32_t;
+    static constexpr int bytespp = 4;
+};
+
+static_assert(sizeof(RGB8::Pixel) == 3 && sizeof(RGBA8::Pixel) == 4, "pixels must be tightly packed");
+
+
+/// 不持有内存的图像视图，拷贝开销和指针相同，按值传递
+template <class Format>
+class ImageView {
+public:
+    using FormatType = Format;
+    using Pixel = typename Format::Pixel;
+
+    ImageView() = default;
+
+    /// \param stride 相邻两行起点相差的像素数
+    ImageView(Pixel *data, int w, int h, std::ptrdiff_t stride) : data_(data), width_(w), height_(h), stride_(stride) {}
+
+    explicit operator bool() const { return data_ != nullptr; }
+
+    [[nodiscard]] int width() const { return width_; }
+
+    [[nodiscard]] int height() const { return height_; }
+
+    [[nodiscard]] std::ptrdiff_t stride() const { return stride_; }
+
+    /// 第 y 行的起点，不检查边界
+    [[nodiscard]] Pixel *row(int y) const { return data_ + y * stride_; }
+
+    /// 不检查边界
+    [[nodiscard]] Pixel &at(int x, int y) const { return data_[y * stride_ + x]; }
+
+    [[nodiscard]] bool contains(int x, int y) const {
+        return (unsigned)x < (unsigned)width_ && (unsigned)y < (unsigned)height_;
+    }
+
+    /// 左上角 (x, y)、大小 w * h 的子区域，共用同一块内存
+    [[nodiscard]] ImageView sub(int x, int y, int w, int h) const { return ImageView(row(y) + x, w, h, stride_); }
+
+    void fill(Pixel p) const {
+        for (int y = 0; y < height_; y++) std::fill(row(y), row(y) + width_, p);
+    }
+
+private:
+    Pixel *data_ = nullptr;
+    int width_ = 0, height_ = 0;
+    std::ptrdiff_t stride_ = 0;
+};
+
+
+/// 持有内存的图像，逐行连续存放
+template <class Format>
+class Image {
+public:
+    using Pixel = typename Format::Pixel;
+
+    Image() = default;
+
+    Image(int w, int h, Pixel value = Pixel()) { resize(w, h, value); }
+
+    void resize(int w, int h, Pixel value = Pixel()) {
+        width_ = w;
+        height_ = h;
+        pixels_.assign((size_t)w * h, value);
+    }
+
+    [[nodiscard]] int width() const { return width_; }
+
+    [[nodiscard]] int height() const { return height_; }
+
+    Pixel *data() { return pixels_.data(); }
+
+    const Pixel *data() const { return pixels_.data(); }
+
+    Pixel *row(int y) { return pixels_.data() + (size_t)y * width_; }
+
+    const Pixel *row(int y) const { return pixels_.data() + (size_t)y * width_; }
+
+    Pixel &at(int x, int y) { return row(y)[x]; }
+
+    const Pixel &at(int x, int y) const { return row(y)[x]; }
+
+    void fill(Pixel value) { std::fill(pixels_.begin(), pixels_.end(), value); }
+
+    ImageView<Format> view() { return ImageView<Format>(pixels_.data(), width_, height_, width_); }
+
+private:
+    std::vector<Pixel> pixels_;
+    int width_ = 0, height_ = 0;
+};
+
+
+/// TGAImage 的像素格式是 Format 时返回它的视图，否则返回空视图
+template <class Format>
+ImageView<Format> imageView(TGAImage &image) {
+    if (image.get_bytespp() != Format::bytespp || !image.buffer()) return {};
+    using Pixel = typename Format::Pixel;
+    return ImageView<Format>(reinterpret_cast<Pixel *>(image.buffer()), image.get_width(), image.get_height(),
+                             image.get_width());
+}
+
+/// 按 TGAImage 实际的像素格式调用 fn(ImageView<Format>)，格式不支持时返回 false
+template <class Fn>
+bool visitColorView(TGAImage &image, Fn &&fn) {
+    if (!image.buffer()) return false;
+    switch (image.get_bytespp()) {
+        case TGAImage::GRAYSCALE: fn(imageView<Gray8>(image)); return true;
+        case TGAImage::RGB: fn(imageView<RGB8>(image)); return true;
+        case TGAImage::RGBA: fn(imageView<RGBA8>(image)); return true;
+        default: return false;
+    }
+}
+
+#endif //IMAGE_H_
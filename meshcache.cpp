@@ -0,0 +1,175 @@
+﻿#include <climits>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+#include "mmap.h"
+#include "model.h"
+
+
+/*
+    二进制网格缓存
+    文件布局：
+        MeshCacheHeader
+        Vec3f  vs[nVerts]
+        Vec2f  uvs[nVerts]
+        Vec3f  norms[nVerts]
+        int32  indices[nFaces * 3]
+    和 Model 内存中的索引网格一一对应，读取时整个文件内存映射，各数组直接整块拷贝
+    源文件大小和修改时间都没变时直接使用缓存；时间变了但内容哈希相同也继续使用，并把新的修改时间写回文件头，
+    下次启动不用再算哈希；否则重新解析 OBJ 并重写缓存
+*/
+namespace {
+
+constexpr char MESH_CACHE_MAGIC[4] = {'T', 'R', 'M', 'C'};
+constexpr uint32_t MESH_CACHE_VERSION = 2;
+
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t headerSize;     // 检查结构体布局是否一致
+    uint32_t endianCheck;    // 0x01020304
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    uint64_t sourceHash;
+    uint64_t nVerts, nFaces;
+};
+
+struct SourceStamp {
+    uint64_t size = 0;
+    int64_t mtime = 0;
+};
+
+bool sourceStamp(const char *filename, SourceStamp &stamp) {
+    std::error_code ec;
+    auto size = std::filesystem::file_size(filename, ec);
+    if (ec) return false;
+    auto mtime = std::filesystem::last_write_time(filename, ec);
+    if (ec) return false;
+    stamp.size = size;
+    stamp.mtime = (int64_t)mtime.time_since_epoch().count();
+    return true;
+}
+
+template <class T>
+void writeArray(std::ofstream &out, const T *data, uint64_t n) {
+    out.write(reinterpret_cast<const char *>(data), (std::streamsize)(n * sizeof(T)));
+}
+
+template <class T>
+const char *readArray(const char *p, const char *end, std::vector<T> &out, uint64_t n) {
+    static_assert(std::is_trivially_copyable_v<T>, "cache arrays are copied as raw bytes");
+    // n 来自文件头，先除再比较，乘法不会溢出
+    if (!p || n > (uint64_t)(end - p) / sizeof(T)) return nullptr;
+    out.resize(n);
+    memcpy(out.data(), p, n * sizeof(T));
+    return p + n * sizeof(T);
+}
+
+/// 只改写缓存文件头里的源文件修改时间，失败了下次启动再算一遍哈希，不影响正确性
+void restampCache(const std::string &path, int64_t mtime) {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    if (!file.is_open()) return;
+    file.seekp(offsetof(MeshCacheHeader, sourceMtime));
+    file.write(reinterpret_cast<const char *>(&mtime), sizeof(mtime));
+}
+
+} // namespace
+
+
+bool Model::writeCache(const char *filename, uint64_t sourceHash) const {
+    SourceStamp stamp;
+    if (!sourceStamp(filename, stamp)) return false;
+
+    MeshCacheHeader header{};
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+    header.version = MESH_CACHE_VERSION;
+    header.headerSize = sizeof(MeshCacheHeader);
+    header.endianCheck = 0x01020304;
+    header.sourceSize = stamp.size;
+    header.sourceMtime = stamp.mtime;
+    header.sourceHash = sourceHash;
+    header.nVerts = vs_.size();
+    header.nFaces = indices_.size() / 3;
+
+    // 先写临时文件再改名，避免中途失败留下半个缓存
+    std::string path = cachePath(filename);
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        if (!out.is_open()) {
+            std::cerr << "can't write mesh cache " << path << "\n";
+            return false;
+        }
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        writeArray(out, vs_.data(), header.nVerts);
+        writeArray(out, uvs_.data(), header.nVerts);
+        writeArray(out, norms_.data(), header.nVerts);
+        writeArray(out, indices_.data(), header.nFaces * 3);
+        if (!out.good()) {
+            out.close();
+            std::filesystem::remove(tmp);
+            std::cerr << "can't write mesh cache " << path << "\n";
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+
+bool Model::readCache(const char *filename) {
+    std::string path = cachePath(filename);
+    MappedFile cache(path.c_str());
+    if (!cache.isOpen() || cache.size() < sizeof(MeshCacheHeader)) return false;
+
+    MeshCacheHeader header;
+    memcpy(&header, cache.data(), sizeof(header));
+    if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != MESH_CACHE_VERSION || header.headerSize != sizeof(MeshCacheHeader) ||
+        header.endianCheck != 0x01020304)
+        return false;
+    // 索引和顶点下标都是 int
+    if (header.nVerts > (uint64_t)INT_MAX || header.nFaces > (uint64_t)INT_MAX / 3) {
+        std::cerr << "corrupted mesh cache " << path << "\n";
+        return false;
+    }
+
+    // 源文件变了才需要算哈希
+    SourceStamp stamp;
+    if (!sourceStamp(filename, stamp) || stamp.size != header.sourceSize) return false;
+    const bool touched = stamp.mtime != header.sourceMtime;
+    if (touched) {
+        MappedFile source(filename);
+        if (!source.isOpen() || hashContent(source.data(), source.size()) != header.sourceHash) return false;
+    }
+
+    const char *p = cache.data() + sizeof(header), *end = cache.data() + cache.size();
+    p = readArray(p, end, vs_, header.nVerts);
+    p = readArray(p, end, uvs_, header.nVerts);
+    p = readArray(p, end, norms_, header.nVerts);
+    p = readArray(p, end, indices_, header.nFaces * 3);
+    bool valid = p != nullptr;
+    for (size_t i = 0; valid && i < indices_.size(); i++)
+        valid = indices_[i] >= 0 && (uint64_t)indices_[i] < header.nVerts;
+    if (!valid) {
+        std::cerr << "corrupted mesh cache " << path << "\n";
+        vs_.clear();
+        uvs_.clear();
+        norms_.clear();
+        indices_.clear();
+        return false;
+    }
+    // 先解除映射，Windows 上映射着的文件打不开写
+    cache.close();
+    if (touched) restampCache(path, stamp.mtime);
+    return true;
+}
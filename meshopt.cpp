@@ -0,0 +1,134 @@
+﻿#include "meshopt.h"
+
+#include "model.h"
+
+
+float simulateACMR(const int *indices, int nTriangles, int nVerts, int cacheSize) {
+    if (nTriangles <= 0) return 0.0f;
+    // 顶点进入缓存时的时间戳，当前时间戳减去它不超过缓存大小即命中
+    std::vector<long> stamp(nVerts, -(long)cacheSize - 1);
+    long now = 0, misses = 0;
+    for (int i = 0; i < nTriangles * 3; i++) {
+        int v = indices[i];
+        if (now - stamp[v] > cacheSize) {
+            stamp[v] = now++;
+            misses++;
+        }
+    }
+    return (float)misses / (float)nTriangles;
+}
+
+
+/*
+    Tipsify
+    以一个“扇心”顶点为中心，依次输出它所有未输出的相邻三角形，
+    再从刚进缓存的顶点里挑下一个扇心：优先选还在缓存里、剩余三角形又不会把自己挤出缓存的，
+    都不行时从最近输出过的顶点（死胡同栈）或按顶点顺序往后找一个还有剩余三角形的
+*/
+void tipsifyTriangles(const int *indices, int nTriangles, int nVerts, int cacheSize, int *out) {
+    // 顶点 -> 相邻三角形，CSR 布局
+    std::vector<int> live(nVerts, 0);
+    for (int i = 0; i < nTriangles * 3; i++) live[indices[i]]++;
+    std::vector<int> adjStart(nVerts + 1, 0);
+    for (int v = 0; v < nVerts; v++) adjStart[v + 1] = adjStart[v] + live[v];
+    std::vector<int> adj(adjStart[nVerts]);
+    {
+        std::vector<int> fill(adjStart.begin(), adjStart.end() - 1);
+        for (int i = 0; i < nTriangles * 3; i++) adj[fill[indices[i]]++] = i / 3;
+    }
+
+    std::vector<long> stamp(nVerts, 0);
+    std::vector<char> emitted(nTriangles, 0);
+    std::vector<int> deadEnd;
+    std::vector<int> candidates;
+    deadEnd.reserve(nTriangles * 3);
+    long now = cacheSize + 1;
+    int cursor = 0;
+    int *o = out;
+
+    auto skipDeadEnd = [&]() {
+        while (!deadEnd.empty()) {
+            int d = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[d] > 0) return d;
+        }
+        for (; cursor < nVerts; cursor++)
+            if (live[cursor] > 0) return cursor;
+        return -1;
+    };
+
+    int fan = skipDeadEnd();
+    while (fan >= 0) {
+        candidates.clear();
+        for (int k = adjStart[fan]; k < adjStart[fan + 1]; k++) {
+            int t = adj[k];
+            if (emitted[t]) continue;
+            emitted[t] = 1;
+            for (int j = 0; j < 3; j++) {
+                int v = indices[t * 3 + j];
+                *o++ = v;
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if (now - stamp[v] > cacheSize) stamp[v] = now++;
+            }
+        }
+
+        int next = -1;
+        long best = -1;
+        for (int v : candidates) {
+            if (live[v] <= 0) continue;
+            // 输出完 v 剩余的三角形后它仍在缓存里，越早进缓存的越优先
+            long priority = 0;
+            if (now - stamp[v] + 2 * live[v] <= cacheSize) priority = now - stamp[v];
+            if (priority > best) {
+                best = priority;
+                next = v;
+            }
+        }
+        fan = next >= 0 ? next : skipDeadEnd();
+    }
+}
+
+
+void reorderVerticesByFirstUse(int *indices, int nIndices, int nVerts, std::vector<int> &remap) {
+    std::vector<int> newIndex(nVerts, -1);
+    remap.clear();
+    remap.reserve(nVerts);
+    for (int i = 0; i < nIndices; i++) {
+        int &v = newIndex[indices[i]];
+        if (v < 0) {
+            v = (int)remap.size();
+            remap.push_back(indices[i]);
+        }
+        indices[i] = v;
+    }
+    for (int v = 0; v < nVerts; v++)
+        if (newIndex[v] < 0) remap.push_back(v);
+}
+
+
+MeshOptStats Model::optimizeVertexOrder(int cacheSize) {
+    MeshOptStats stats;
+    int nTriangles = nFaces(), nVerts = nVert();
+    stats.acmrBefore = simulateACMR(indices_.data(), nTriangles, nVerts, cacheSize);
+
+    std::vector<int> reordered(indices_.size());
+    tipsifyTriangles(indices_.data(), nTriangles, nVerts, cacheSize, reordered.data());
+
+    // Tipsify 输出时保持了每个三角形内的顶点顺序，绕序不变
+    std::vector<int> remap;
+    reorderVerticesByFirstUse(reordered.data(), (int)reordered.size(), nVerts, remap);
+    indices_.swap(reordered);
+
+    auto permute = [&](auto &arr) {
+        auto old = arr;
+        for (int i = 0; i < nVerts; i++) arr[i] = old[remap[i]];
+    };
+    permute(vs_);
+    permute(uvs_);
+    permute(norms_);
+
+    stats.acmrAfter = simulateACMR(indices_.data(), nTriangles, nVerts, cacheSize);
+    return stats;
+}
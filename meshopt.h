@@ -0,0 +1,30 @@
+﻿#ifndef MESHOPT_H_
+#define MESHOPT_H_
+
+#include <vector>
+
+
+/*
+    三角形/顶点重排，提高顶点复用和访存局部性
+    只改变顺序，不改变三角形本身和顶点绕序
+*/
+
+/// 统计 ACMR 时默认模拟的 FIFO 顶点缓存大小
+constexpr int MESH_OPT_CACHE_SIZE = 16;
+
+/// 用 FIFO 顶点缓存模拟平均每个三角形的缓存缺失数 (ACMR)，理想值接近 0.5，最差为 3
+/// \param indices 每 3 个一组的三角形顶点下标
+/// \param nTriangles 三角形个数
+/// \param nVerts 顶点个数
+/// \param cacheSize 缓存大小
+float simulateACMR(const int *indices, int nTriangles, int nVerts, int cacheSize = MESH_OPT_CACHE_SIZE);
+
+/// Tipsify 三角形重排 (Sander et al. 2007)，线性时间
+/// \param out 输出 nTriangles * 3 个下标，不能和 indices 相同
+void tipsifyTriangles(const int *indices, int nTriangles, int nVerts, int cacheSize, int *out);
+
+/// 按三角形中第一次出现的顺序给顶点重新编号，原地改写 indices
+/// \param remap 输出，新下标 -> 旧下标，没有被引用的顶点排在最后
+void reorderVerticesByFirstUse(int *indices, int nIndices, int nVerts, std::vector<int> &remap);
+
+#endif //MESHOPT_H_
@@ -0,0 +1,138 @@
+﻿#include "mmap.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "parallel.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::MappedFile(MappedFile &&other) noexcept { *this = std::move(other); }
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        close();
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(copyOnWrite_, other.copyOnWrite_);
+#ifdef _WIN32
+        std::swap(file_, other.file_);
+        std::swap(mapping_, other.mapping_);
+#endif
+    }
+    return *this;
+}
+
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char *filename, bool copyOnWrite) {
+    close();
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+    void *view = MapViewOfFile(mapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    file_ = file;
+    mapping_ = mapping;
+    data_ = static_cast<const char *>(view);
+    size_ = (size_t)size.QuadPart;
+    copyOnWrite_ = copyOnWrite;
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle(mapping_);
+    if (file_) CloseHandle(file_);
+    data_ = nullptr;
+    mapping_ = nullptr;
+    file_ = nullptr;
+    size_ = 0;
+    copyOnWrite_ = false;
+}
+
+#else
+
+bool MappedFile::open(const char *filename, bool copyOnWrite) {
+    close();
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st {};
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    int prot = copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *view = mmap(nullptr, (size_t)st.st_size, prot, MAP_PRIVATE, fd, 0);
+    ::close(fd);  // 映射建立后文件描述符可以关闭
+    if (view == MAP_FAILED) return false;
+    madvise(view, (size_t)st.st_size, MADV_SEQUENTIAL);
+    data_ = static_cast<const char *>(view);
+    size_ = (size_t)st.st_size;
+    copyOnWrite_ = copyOnWrite;
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) munmap(const_cast<char *>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+    copyOnWrite_ = false;
+}
+
+#endif
+
+
+static uint64_t hashBlock(const char *p, size_t n, uint64_t seed) {
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t h = seed ^ (n * 0x9e3779b97f4a7c15ULL);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h = (h ^ w) * prime;
+        h ^= h >> 29;
+    }
+    for (; i < n; i++) h = (h ^ (unsigned char)p[i]) * prime;
+    return h;
+}
+
+uint64_t hashContent(const char *data, size_t size) {
+    const size_t blockSize = 1 << 20;
+    size_t nBlocks = (size + blockSize - 1) / blockSize;
+    std::vector<uint64_t> blocks(nBlocks);
+    defaultThreadPool().run((int)nBlocks, [&](int i) {
+        size_t begin = (size_t)i * blockSize;
+        blocks[i] = hashBlock(data + begin, std::min(blockSize, size - begin), 0xcbf29ce484222325ULL);
+    });
+    uint64_t h = hashBlock(reinterpret_cast<const char *>(&size), sizeof(size), 0xcbf29ce484222325ULL);
+    return hashBlock(reinterpret_cast<const char *>(blocks.data()), blocks.size() * sizeof(uint64_t), h);
+}
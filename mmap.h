@@ -0,0 +1,53 @@
+﻿#ifndef MMAP_H_
+#define MMAP_H_
+
+#include <cstddef>
+#include <cstdint>
+
+
+/*
+    只读内存映射文件，Windows 和 POSIX 两种实现
+    映射失败（文件不存在、空文件）时 data() 返回 nullptr
+    写时复制方式打开时可以通过 mutableData() 修改，改动只在本进程内可见，不会写回文件
+*/
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const char *filename, bool copyOnWrite = false) { open(filename, copyOnWrite); }
+
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    bool open(const char *filename, bool copyOnWrite = false);
+
+    void close();
+
+    [[nodiscard]] bool isOpen() const { return data_ != nullptr; }
+
+    [[nodiscard]] const char *data() const { return data_; }
+
+    /// 只有以写时复制方式打开时才能写
+    [[nodiscard]] char *mutableData() const { return copyOnWrite_ ? const_cast<char *>(data_) : nullptr; }
+
+    [[nodiscard]] size_t size() const { return size_; }
+
+private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+    bool copyOnWrite_ = false;
+#ifdef _WIN32
+    void *file_ = nullptr;
+    void *mapping_ = nullptr;
+#endif
+};
+
+/// 文件内容的 64 位哈希，按固定大小分块并行计算，结果与线程数无关
+uint64_t hashContent(const char *data, size_t size);
+
+#endif //MMAP_H_
@@ -1,72 +1,338 @@
 ﻿#include "model.h"
-#include <fstream>
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
 #include <iostream>
-#include <sstream>
 #include <string>
 #include <vector>
 
-Model::Model(const char *filename, const char *diffuseFilename) : vs_(), uvs_(), faces_() {
-    std::ifstream in;
-    in.open(filename, std::ifstream::in);
-    if (in.fail()) {
-        std::cerr << "Failed to open file: " << filename << std::endl;
-        return;
+#include "mmap.h"
+#include "parallel.h"
+
+
+/*
+    OBJ 解析
+    1. 整个文件内存映射，按行边界切成若干块
+    2. 第一遍并行统计每块的 v/vt/vn/f 数量，前缀和得到每块在总数组中的起点，数组一次分配到位
+    3. 第二遍并行解析，各块直接写入自己的区间，负数下标用“块起点 + 块内已读数量”换算成绝对下标
+    4. 多边形按扇形三角化，(位置, 纹理坐标, 法线) 完全相同的角点合并成同一个顶点，
+       所有三角形放进一个连续的下标数组
+*/
+namespace {
+
+struct ObjCounts {
+    size_t v = 0, vt = 0, vn = 0, f = 0;
+    size_t corners = 0;  // 所有面的角点总数
+};
+
+struct ObjChunk {
+    const char *begin, *end;
+    ObjCounts counts;  // 本块数量
+    ObjCounts offset;  // 本块之前所有块的数量
+};
+
+constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+
+inline bool isBlank(char c) { return c == ' ' || c == '\t'; }
+
+inline const char *skipBlank(const char *p, const char *end) {
+    while (p < end && isBlank(*p)) p++;
+    return p;
+}
+
+inline const char *lineEnd(const char *p, const char *end) {
+    while (p < end && *p != '\n') p++;
+    return p;
+}
+
+inline bool parseFloat(const char *&p, const char *end, float &out) {
+    p = skipBlank(p, end);
+#if defined(__cpp_lib_to_chars)
+    if (p < end && *p == '+') p++;  // from_chars 不接受前导 '+'
+    auto res = std::from_chars(p, end, out);
+    if (res.ec != std::errc()) return false;
+    p = res.ptr;
+    return true;
+#else
+    // 映射的内存不以 '\0' 结尾，拷贝到局部缓冲再交给 strtof
+    char buf[64];
+    size_t n = std::min<size_t>(sizeof(buf) - 1, (size_t)(end - p));
+    std::copy(p, p + n, buf);
+    buf[n] = '\0';
+    char *next = nullptr;
+    out = std::strtof(buf, &next);
+    if (next == buf) return false;
+    p += next - buf;
+    return true;
+#endif
+}
+
+inline bool parseInt(const char *&p, const char *end, long &out) {
+    if (p < end && *p == '+') p++;
+    auto res = std::from_chars(p, end, out);
+    if (res.ec != std::errc()) return false;
+    p = res.ptr;
+    return true;
+}
+
+/// 行的类型，只看前两个字符
+enum class LineType { Other, Vertex, TexCoord, Normal, Face };
+
+inline LineType lineType(const char *p, const char *end) {
+    if (end - p < 2) return LineType::Other;
+    if (p[0] == 'v') {
+        if (isBlank(p[1])) return LineType::Vertex;
+        if (end - p >= 3 && isBlank(p[2])) {
+            if (p[1] == 't') return LineType::TexCoord;
+            if (p[1] == 'n') return LineType::Normal;
+        }
+    } else if (p[0] == 'f' && isBlank(p[1])) {
+        return LineType::Face;
     }
+    return LineType::Other;
+}
 
-    std::string line;
-    while (!in.eof()) {
-        std::getline(in, line);
-        std::istringstream iss(line.c_str());
-        char trash;
-        if (!line.compare(0, 2, "v ")) {
-            iss >> trash;
-            Vec3f v;
-            for (int i = 0; i < 3; i++) iss >> v[i];
-            vs_.push_back(v);
-        } else if (!line.compare(0, 3, "vt ")) {
-            iss >> trash >> trash;
-            Vec3f uv;
-            for (int i = 0; i < 3; i++) iss >> uv[i];
-            uvs_.emplace_back(uv.x, uv.y);
-        } else if (!line.compare(0, 3, "vn ")) {
-            iss >> trash >> trash;
-            Vec3f nor;
-            for (int i = 0; i < 3; i++) iss >> nor[i];
-            norms_.push_back(nor);
-        } else if (!line.compare(0, 2, "f ")) {
-            std::vector<ids> f;
-            int vIdx, uvIdx, nmIdx;
-            iss >> trash;
-            while (iss >> vIdx >> trash >> uvIdx >> trash >> nmIdx) {
-                vIdx--;  // in wavefront obj all indices start at 1, not zero
-                uvIdx--;
-                nmIdx--;
-                f.emplace_back(vIdx, uvIdx, nmIdx);
-            }
-            faces_.push_back(f);
+/// 面的角点个数，空白分隔的每一段算一个
+inline size_t countCorners(const char *p, const char *end) {
+    size_t n = 0;
+    while (true) {
+        p = skipBlank(p, end);
+        if (p >= end || *p == '#' || *p == '\r') return n;
+        n++;
+        while (p < end && !isBlank(*p)) p++;
+    }
+}
+
+ObjCounts countLines(const char *p, const char *end) {
+    ObjCounts c;
+    while (p < end) {
+        const char *e = lineEnd(p, end);
+        switch (lineType(skipBlank(p, e), e)) {
+            case LineType::Vertex: c.v++; break;
+            case LineType::TexCoord: c.vt++; break;
+            case LineType::Normal: c.vn++; break;
+            case LineType::Face:
+                c.f++;
+                c.corners += countCorners(skipBlank(p, e) + 1, e);
+                break;
+            default: break;
         }
+        p = e + 1;
+    }
+    return c;
+}
+
+/// OBJ 下标从 1 开始，负数表示相对当前已定义数量倒数，0 或越界视为缺失
+inline int resolveIndex(long idx, size_t defined, size_t total) {
+    long res = idx > 0 ? idx - 1 : (long)defined + idx;
+    if (idx == 0 || res < 0 || res >= (long)total) return -1;
+    return (int)res;
+}
+
+} // namespace
+
+
+Model::Model(const char *filename, const char *diffuseFilename, bool useCache) {
+    if (!useCache || !readCache(filename)) {
+        uint64_t sourceHash = 0;
+        if (loadObj(filename, sourceHash) && useCache) writeCache(filename, sourceHash);
     }
+    computeBounds();
 
     if (diffuseFilename != nullptr) {
-        diffuseMap.read_tga_file(diffuseFilename);
-        diffuseMap.flip_vertically();
-        diffuseMapSize = Vec2i(diffuseMap.get_width(), diffuseMap.get_height());
+        TGAImage image;
+        image.read_tga_file(diffuseFilename, true);  // 纹理坐标的原点在左下角
+        diffuseMap.load(image);
+    }
+
+    std::cerr << "# v# " << vs_.size() << " uv# " << uvs_.size() << " f# " << nFaces() << std::endl;
+}
+
+
+bool Model::loadObj(const char *filename, uint64_t &sourceHash) {
+    MappedFile file(filename);
+    if (!file.isOpen()) {
+        std::cerr << "Failed to open file: " << filename << std::endl;
+        return false;
+    }
+    sourceHash = hashContent(file.data(), file.size());
+
+    // 按行边界切块
+    const char *data = file.data(), *dataEnd = data + file.size();
+    ThreadPool &pool = defaultThreadPool();
+    size_t nChunks = std::max<size_t>(1, std::min<size_t>(pool.nThreads() * 4, file.size() / MIN_CHUNK_BYTES));
+    std::vector<ObjChunk> chunks;
+    const char *p = data;
+    for (size_t i = 1; i <= nChunks && p < dataEnd; i++) {
+        const char *e = i == nChunks ? dataEnd : data + file.size() * i / nChunks;
+        if (e < p) e = p;
+        e = std::min(lineEnd(e, dataEnd) + 1, dataEnd);
+        chunks.push_back({p, e, {}, {}});
+        p = e;
+    }
+
+    pool.run((int)chunks.size(), [&](int i) { chunks[i].counts = countLines(chunks[i].begin, chunks[i].end); });
+
+    ObjCounts total;
+    for (auto &c : chunks) {
+        c.offset = total;
+        total.v += c.counts.v;
+        total.vt += c.counts.vt;
+        total.vn += c.counts.vn;
+        total.f += c.counts.f;
+        total.corners += c.counts.corners;
+    }
+    std::vector<Vec3f> positions(total.v);
+    std::vector<Vec2f> texcoords(total.vt);
+    std::vector<Vec3f> normals(total.vn);
+    std::vector<ids> corners(total.corners);
+    std::vector<size_t> faceStart(total.f);   // 面在 corners 中的起点
+    std::vector<uint32_t> faceSize(total.f);  // 0 表示非法的面
+
+    pool.run((int)chunks.size(), [&](int i) {
+        const ObjChunk &chunk = chunks[i];
+        ObjCounts at = chunk.offset;  // 当前行之前已定义的总数
+        const char *p = chunk.begin;
+        while (p < chunk.end) {
+            const char *e = lineEnd(p, chunk.end);
+            const char *s = skipBlank(p, e);
+            switch (lineType(s, e)) {
+                case LineType::Vertex: {
+                    Vec3f &v = positions[at.v++];
+                    s += 1;
+                    for (int k = 0; k < 3; k++) parseFloat(s, e, v[k]);
+                    break;
+                }
+                case LineType::TexCoord: {
+                    Vec2f &uv = texcoords[at.vt++];
+                    s += 2;
+                    parseFloat(s, e, uv.x);
+                    parseFloat(s, e, uv.y);
+                    break;
+                }
+                case LineType::Normal: {
+                    Vec3f &n = normals[at.vn++];
+                    s += 2;
+                    for (int k = 0; k < 3; k++) parseFloat(s, e, n[k]);
+                    break;
+                }
+                case LineType::Face: {
+                    // v, v/vt, v//vn, v/vt/vn 四种写法
+                    size_t start = at.corners, count = countCorners(s + 1, e);
+                    ids *f = corners.data() + start;
+                    uint32_t n = 0;
+                    s += 1;
+                    bool valid = true;
+                    while (n < count) {
+                        s = skipBlank(s, e);
+                        long v = 0, vt = 0, vn = 0;
+                        if (!parseInt(s, e, v)) break;
+                        if (s < e && *s == '/') {
+                            s++;
+                            if (s < e && *s != '/') parseInt(s, e, vt);
+                            if (s < e && *s == '/') {
+                                s++;
+                                parseInt(s, e, vn);
+                            }
+                        }
+                        int vIdx = resolveIndex(v, at.v, total.v);
+                        valid = valid && vIdx >= 0;
+                        f[n++] = ids(vIdx, resolveIndex(vt, at.vt, total.vt), resolveIndex(vn, at.vn, total.vn));
+                        if (s < e && !isBlank(*s)) break;  // 无法识别的内容
+                    }
+                    faceStart[at.f] = start;
+                    faceSize[at.f++] = (valid && n >= 3) ? n : 0;  // 顶点下标非法的面丢弃
+                    at.corners += count;
+                    break;
+                }
+                default:
+                    break;
+            }
+            p = e + 1;
+        }
+    });
+
+    size_t dropped = std::count(faceSize.begin(), faceSize.end(), 0u);
+    if (dropped)
+        std::cerr << "dropped " << dropped << " invalid faces in " << filename << std::endl;
+
+    buildIndexedMesh(positions, texcoords, normals, corners, faceStart, faceSize);
+    return true;
+}
+
+
+void Model::buildIndexedMesh(const std::vector<Vec3f> &positions, const std::vector<Vec2f> &texcoords,
+                             const std::vector<Vec3f> &normals, const std::vector<ids> &corners,
+                             const std::vector<size_t> &faceStart, const std::vector<uint32_t> &faceSize) {
+    size_t nTriangles = 0;
+    for (uint32_t n : faceSize) nTriangles += n ? n - 2 : 0;
+    indices_.clear();
+    indices_.reserve(nTriangles * 3);
+    vs_.clear();
+    uvs_.clear();
+    norms_.clear();
+    vs_.reserve(positions.size());
+    uvs_.reserve(positions.size());
+    norms_.reserve(positions.size());
+
+    // 每个位置挂一条链表，记录以它为位置的合并后顶点，链表通常只有一两个节点
+    std::vector<int> head(positions.size(), -1);
+    std::vector<int> next;
+    std::vector<ids> key;
+    next.reserve(positions.size());
+    key.reserve(positions.size());
+    auto unify = [&](const ids &c) {
+        for (int i = head[c.vIdx]; i >= 0; i = next[i])
+            if (key[i].uvIdx == c.uvIdx && key[i].normIdx == c.normIdx) return i;
+        int idx = (int)vs_.size();
+        vs_.push_back(positions[c.vIdx]);
+        uvs_.push_back(c.uvIdx >= 0 ? texcoords[c.uvIdx] : Vec2f());
+        norms_.push_back(c.normIdx >= 0 ? normals[c.normIdx] : Vec3f());
+        key.push_back(c);
+        next.push_back(head[c.vIdx]);
+        head[c.vIdx] = idx;
+        return idx;
+    };
+
+    // 按扇形三角化：(0, k - 1, k)
+    int tri[3];
+    for (size_t i = 0; i < faceSize.size(); i++) {
+        uint32_t n = faceSize[i];
+        if (n < 3) continue;
+        const ids *f = corners.data() + faceStart[i];
+        tri[0] = unify(f[0]);
+        tri[2] = unify(f[1]);
+        for (uint32_t k = 2; k < n; k++) {
+            tri[1] = tri[2];
+            tri[2] = unify(f[k]);
+            indices_.insert(indices_.end(), tri, tri + 3);
+        }
     }
+}
 
-    std::cerr << "# v# " << vs_.size() << " uv# " << uvs_.size() << " f# " << faces_.size() << std::endl;
+void Model::computeBounds() {
+    if (vs_.empty()) {
+        bboxMin_ = bboxMax_ = Vec3f();
+        return;
+    }
+    bboxMin_ = bboxMax_ = vs_[0];
+    for (Vec3f v : vs_) {
+        for (int k = 0; k < 3; k++) {
+            bboxMin_[k] = std::min(bboxMin_[k], v[k]);
+            bboxMax_[k] = std::max(bboxMax_[k], v[k]);
+        }
+    }
 }
 
+
 Vec3f Model::vert(int iface, int nthVert) {
-    auto idx = faces_[iface][nthVert].vIdx;
-    return vs_[idx];
+    return vs_[indices_[iface * 3 + nthVert]];
 }
 
 Vec2f Model::uv(int iface, int nthVert) {
-    auto idx = faces_[iface][nthVert].uvIdx;
-    return uvs_[idx];
+    return uvs_[indices_[iface * 3 + nthVert]];
 }
 
 Vec3f Model::normal(int iface, int nthVert) {
-    auto idx = faces_[iface][nthVert].normIdx;
-    return norms_[idx];
+    return norms_[indices_[iface * 3 + nthVert]];
 }
@@ -1,10 +1,13 @@
 ﻿#ifndef __MODEL_H__
 #define __MODEL_H__
 
+#include <cstdint>
+#include <string>
 #include <vector>
 #include "GMath.h"
+#include "meshopt.h"
+#include "texture.h"
 #include "tgaimage.h"
-#include <opencv2/opencv.hpp>
 
 struct ids {
     int vIdx, uvIdx, normIdx;
@@ -13,18 +16,40 @@ struct ids {
     ids(int v, int uv, int other) : vIdx(v), uvIdx(uv), normIdx(other) {}
 };
 
+/// Model::optimizeVertexOrder 前后的平均缓存缺失数 (ACMR)
+struct MeshOptStats {
+    float acmrBefore = 0.0f;
+    float acmrAfter = 0.0f;
+};
+
 class Model {
 private:
+    /*
+        索引网格：vs_/uvs_/norms_ 按合并后的顶点一一对应，缺失的纹理坐标/法线为零向量
+        indices_ 每 3 个一组，对应一个三角形
+    */
     std::vector<Vec3f> vs_;
     std::vector<Vec2f> uvs_;
     std::vector<Vec3f> norms_;
-    std::vector<std::vector<ids> > faces_;
+    std::vector<int> indices_;
+    Vec3f bboxMin_, bboxMax_;  // 模型空间包围盒，加载后算一次
+
+    Texture diffuseMap;
+    TextureFilter filter_ = TextureFilter::Trilinear;
 
-    TGAImage diffuseMap;
-    Vec2i diffuseMapSize;
+    bool loadObj(const char *filename, uint64_t &sourceHash);
+
+    /// 扇形三角化并合并相同的 (位置, 纹理坐标, 法线) 角点
+    /// \param faceSize 每个面的角点数，0 表示丢弃
+    void buildIndexedMesh(const std::vector<Vec3f> &positions, const std::vector<Vec2f> &texcoords,
+                          const std::vector<Vec3f> &normals, const std::vector<ids> &corners,
+                          const std::vector<size_t> &faceStart, const std::vector<uint32_t> &faceSize);
+
+    void computeBounds();
 
 public:
-    Model(const char *filename, const char *diffuseFilename);
+    /// \param useCache 优先读取 filename + ".cache" 二进制缓存，源文件变化时自动重建
+    Model(const char *filename, const char *diffuseFilename, bool useCache = true);
 
     ~Model() = default;
 
@@ -32,7 +57,8 @@ public:
 
     int nUvs() { return (int) uvs_.size(); }
 
-    int nFaces() { return (int) faces_.size(); }
+    /// 三角形个数
+    int nFaces() const { return (int) (indices_.size() / 3); }
 
     int nNormals() { return (int) norms_.size(); }
 
@@ -43,7 +69,21 @@ public:
 
     Vec3f normal(int idx) { return norms_[idx]; };
 
-    std::vector<ids> face(int idx) { return faces_[idx]; };
+    /// 第 idx 个三角形的 3 个顶点下标
+    const int *face(int idx) const { return indices_.data() + idx * 3; };
+
+    const Vec3f *verts() const { return vs_.data(); }
+
+    const Vec2f *uvs() const { return uvs_.data(); }
+
+    const Vec3f *normals() const { return norms_.data(); }
+
+    const int *indices() const { return indices_.data(); }
+
+    /// 模型空间轴对齐包围盒，整个物体的视锥剔除用
+    Vec3f bboxMin() const { return bboxMin_; }
+
+    Vec3f bboxMax() const { return bboxMax_; }
 
 
     Vec3f vert(int iface, int nthVert) ;
@@ -53,9 +93,35 @@ public:
     Vec3f normal(int iface, int nthVert);
 
 
-    TGAColor diffuse(float u, float v) {
-        return diffuseMap.get(int(diffuseMapSize.x * u), int(diffuseMapSize.y * v));
-    }
+    /// 重排三角形提高顶点复用 (Tipsify)，再按首次使用的顺序重排顶点数组，见 meshopt.cpp
+    /// \param cacheSize 按多大的顶点缓存优化和统计
+    MeshOptStats optimizeVertexOrder(int cacheSize = MESH_OPT_CACHE_SIZE);
+
+
+    /// 二进制网格缓存，见 meshcache.cpp
+    static std::string cachePath(const char *filename) { return std::string(filename) + ".cache"; }
+
+    bool writeCache(const char *filename, uint64_t sourceHash) const;
+
+    bool readCache(const char *filename);
+
+
+    /// 第 0 层最近邻采样
+    TGAColor diffuse(float u, float v) const { return diffuseMap.sample(u, v, 0.0f, TextureFilter::Nearest); }
+
+    /// 按当前过滤方式采样
+    /// \param lod diffuseLod() 的结果
+    TGAColor diffuse(float u, float v, float lod) const { return diffuseMap.sample(u, v, lod, filter_); }
+
+    /// \param uvdx 纹理坐标对屏幕 x 的偏导
+    /// \param uvdy 纹理坐标对屏幕 y 的偏导
+    float diffuseLod(Vec2f uvdx, Vec2f uvdy) const { return diffuseMap.lod(uvdx, uvdy); }
+
+    const Texture &diffuseTexture() const { return diffuseMap; }
+
+    TextureFilter textureFilter() const { return filter_; }
+
+    void setTextureFilter(TextureFilter filter) { filter_ = filter; }
 };
 
 #endif //__MODEL_H__
\ No newline at end of file
@@ -1,14 +1,14 @@
 ﻿#include "mvp.h"
 
 constexpr float MY_PI = 3.1415926f;
-const int depth = 255;
+const int depth = VIEWPORT_DEPTH;
 
 
-Matrix modelMatrix(float rotation_angle, Vec3f axis) {
+Mat4 modelMatrix(float rotation_angle, Vec3f axis) {
     axis.normalize();
     rotation_angle = rotation_angle * MY_PI / 180.f;
 
-    Matrix nnT = Matrix::identity(4), crossN(4, 4);
+    Mat4 nnT = Mat4::identity(), crossN;
     float cosAlpha = cos(rotation_angle);
     float sinAlpha = sin(rotation_angle);
     float x = axis.x, y = axis.y, z = axis.z;
@@ -30,7 +30,7 @@ Matrix modelMatrix(float rotation_angle, Vec3f axis) {
     crossN[2][0] = -y, crossN[2][1] = x,
     crossN[3][3] = 1;
 
-    Matrix rotate = Matrix::identity(4) * cosAlpha + (1 - cosAlpha) * nnT + sinAlpha * crossN;
+    Mat4 rotate = Mat4::identity() * cosAlpha + (1 - cosAlpha) * nnT + sinAlpha * crossN;
     rotate[3][3] = 1;
     return rotate;
 }
@@ -43,12 +43,12 @@ Matrix modelMatrix(float rotation_angle, Vec3f axis) {
 /// \param targetPos
 /// \param up
 /// \return
-Matrix lookAt(Vec3f eyePos, Vec3f &targetPos, Vec3f &up) {
+Mat4 lookAt(Vec3f eyePos, Vec3f &targetPos, Vec3f &up) {
     Vec3f z = (eyePos - targetPos).normalize();
     Vec3f x = cross(up, z).normalize();
     Vec3f y = cross(z, x).normalize();
-    Matrix invM = Matrix::identity(4);
-    Matrix translate = Matrix::identity(4);
+    Mat4 invM = Mat4::identity();
+    Mat4 translate = Mat4::identity();
     for (int i = 0; i < 3; i++) {
         invM[0][i] = x[i];
         invM[1][i] = y[i];
@@ -65,37 +65,34 @@ Matrix lookAt(Vec3f eyePos, Vec3f &targetPos, Vec3f &up) {
 /// \param zNear 近平面
 /// \param zFar 远平面
 /// \return
-Matrix projection(float eye_fov, float aspect_ratio,
-                  float zNear, float zFar) {
-    Matrix res;
-    Matrix orth, orthTranslate, orthScale, pers2orth;
+Mat4 projection(float eye_fov, float aspect_ratio,
+                float zNear, float zFar) {
+    Mat4 res;
+    Mat4 orth, orthTranslate, orthScale, pers2orth;
     float n = -zNear, f = -zFar;
     float t = tan(eye_fov / 2) * (-n), b = -t;
     float r = aspect_ratio * t, l = -r;
 
-    std::vector<float> p2o = {
+    pers2orth = {
             n, 0, 0, 0,
             0, n, 0, 0,
             0, 0, n + f, -n * f,
             0, 0, 1, 0
     };
-    pers2orth = Matrix(p2o);
 
-    std::vector<float> scale = {
+    orthScale = {
             2.f/(r - l), 0, 0, 0,
             0, 2.f/(t - b), 0, 0,
             0, 0, 2.f/(n - f), 0,
             0, 0, 0, 1
     };
-    orthScale = Matrix(scale);
 
-    std::vector<float> trans = {
+    orthTranslate = {
             1, 0, 0, -(r + l) / 2.f,
             0, 1, 0, -(t + b) / 2.f,
             0, 0, 1, -(n + f) / 2.f,
             0, 0, 0, 1
     };
-    orthTranslate = Matrix(trans);
 
     orth = orthScale * orthTranslate;  // 先平移，再缩放
     res = orth * pers2orth;  // 先透视，再正交
@@ -104,19 +101,25 @@ Matrix projection(float eye_fov, float aspect_ratio,
 
 
 
-Matrix &projdivision(Matrix &clip) {
-    Matrix &ndc = clip;
-    ndc[0][0] = clip[0][0] / clip[3][0];
-    ndc[1][0] = clip[1][0] / clip[3][0];
-    ndc[2][0] = clip[2][0] / clip[3][0];
-    ndc[3][0] = 1.0f;
-    return ndc;
+Mat4 orthographic(float l, float r, float b, float t, float zNear, float zFar) {
+    // 齐次坐标整体乘 -1 不改变除以 w 之后的结果
+    return {
+            -2.f / (r - l), 0, 0, (r + l) / (r - l),
+            0, -2.f / (t - b), 0, (t + b) / (t - b),
+            0, 0, -2.f / (zFar - zNear), -(zNear + zFar) / (zFar - zNear),
+            0, 0, 0, -1
+    };
+}
+
+
+Vec4f projdivision(const Vec4f &clip) {
+    return {clip.x / clip.w, clip.y / clip.w, clip.z / clip.w, 1.0f};
 }
 
 
-Matrix viewport(int x, int y, int w, int h) {
+Mat4 viewport(int x, int y, int w, int h) {
     // [-1,1]*[-1,1]*[-1,1]平移到[0,2]*[0,2]*[0,2]
-    std::vector<float> nums1 = {
+    Mat4 nums1 = {
             1, 0, 0, 1,
             0, 1, 0, 1,
             0, 0, 1, 1,
@@ -124,7 +127,7 @@ Matrix viewport(int x, int y, int w, int h) {
     };
 
     // [0,2]*[0,2]*[0,2]缩放到[0,1]*[0,1]*[0,1]
-    std::vector<float> nums2 = {
+    Mat4 nums2 = {
             0.5f, 0, 0, 0,
             0, 0.5f, 0, 0,
             0, 0, 0.5f, 0,
@@ -132,7 +135,7 @@ Matrix viewport(int x, int y, int w, int h) {
     };
 
 //    [0,1]*[0,1]*[0,1]缩放到[0,w]*[0,h]*[0,d]
-    std::vector<float> nums3 = {
+    Mat4 nums3 = {
             static_cast<float>(w), 0, 0, 0,
             0, static_cast<float>(h), 0, 0,
             0, 0, depth, 0,
@@ -140,16 +143,15 @@ Matrix viewport(int x, int y, int w, int h) {
     };
 
 //    [0,w]*[0,h]*[0,d]移动到[x,x+w]*[y,y+h]*[0,d]
-    std::vector<float> nums4 = {
+    Mat4 nums4 = {
             1, 0, 0, static_cast<float>(x),
             0, 1, 0, static_cast<float>(y),
             0, 0, 1, 0,
             0, 0, 0, 1
     };
 
-    Matrix res = Matrix(nums4) * Matrix(nums3) * Matrix(nums2) * Matrix(nums1);
+    Mat4 res = nums4 * nums3 * nums2 * nums1;
 //    std::cout << res << std::endl;
     return res;
 }
 
-IShader::~IShader() = default;
@@ -1,7 +1,6 @@
 ﻿#ifndef MVP_H_
 #define MVP_H_
 
-#include <utility>
 #include "GMath.h"
 #include "tgaimage.h"
 
@@ -15,56 +14,16 @@
         Proj division
         ViewPort Matrix
 */
-Matrix modelMatrix(float rotation_angle, Vec3f axis = {0, 0, 1});
-Matrix lookAt(Vec3f eyePos, Vec3f& targetPos, Vec3f& up);
-Matrix projection(float eye_fov, float aspect_ratio, float zNear, float zFar);
-Matrix& projdivision(Matrix& clip);
-Matrix viewport(int x, int y, int w, int h);
+Mat4 modelMatrix(float rotation_angle, Vec3f axis = {0, 0, 1});
+Mat4 lookAt(Vec3f eyePos, Vec3f& targetPos, Vec3f& up);
+Mat4 projection(float eye_fov, float aspect_ratio, float zNear, float zFar);
+/// 正交投影，观察空间的 [l, r] * [b, t] * [-zFar, -zNear] 映射到 NDC，近处 z 为 1
+/// 整个矩阵乘了 -1，和 projection() 一样相机前方 w < 0，裁剪和剔除的约定不变
+Mat4 orthographic(float l, float r, float b, float t, float zNear, float zFar);
+Vec4f projdivision(const Vec4f& clip);
+/// viewport 把 NDC 的 z 映射到 [0, VIEWPORT_DEPTH]，越大越近
+constexpr int VIEWPORT_DEPTH = 255;
+
+Mat4 viewport(int x, int y, int w, int h);
 
-
-
-
-
-struct fragment_shader_payload {
-    fragment_shader_payload() {
-        // texture = nullptr;
-    }
-
-    fragment_shader_payload(const Vec3f& col, const Vec3f& nor, const Vec2f& tc)
-        : color(col), normal(nor), tex_coords(tc) /*, texture(tex)*/ {}
-
-    Vec3f view_pos;
-    Vec3f color;
-    Vec3f normal;
-    Vec2f tex_coords;
-    // Texture* texture;
-};
-
-struct vertex_shader_payload {
-    Vec3f position;
-};
-
-
-
-
-class IShader {
-   public:
-    void setModel(Matrix model) { modelM = std::move(model); }
-    void setLookAt(Matrix lookat) { lookatM = std::move(lookat); }
-    void setProj(Matrix proj) { projM = std::move(proj); }
-    void setViewPort(Matrix viewport) { viewportM = viewport; }
-    virtual ~IShader();
-    // 1. transform the coordinates of the vertices
-    // 2. prepare data for fragment
-    virtual Vec4f vertex(int iface, int nthvert) = 0;
-    // 1. determine the color of the current pixel.
-    // 2. discard pixel that we don't want
-    virtual bool fragment(Vec3f bar, TGAColor& color) = 0;
-
-   private:
-    Matrix modelM;
-    Matrix lookatM;
-    Matrix projM;
-    Matrix viewportM;
-};
 #endif //MVP_H_
\ No newline at end of file
@@ -0,0 +1,118 @@
+﻿#include "parallel.h"
+
+#include <algorithm>
+
+
+ThreadPool::ThreadPool(int nThreads) {
+    if (nThreads <= 0) nThreads = std::max(1, (int)std::thread::hardware_concurrency());
+    for (int i = 0; i < nThreads; i++) queues_.emplace_back(new TaskQueue());
+    // 0 号队列属于调用 run() 的线程
+    for (int i = 1; i < nThreads; i++) workers_.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &t : workers_) t.join();
+}
+
+
+bool ThreadPool::popTask(int id, int &task) {
+    // 先取自己队列的队头
+    {
+        TaskQueue &own = *queues_[id];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    // 再从其他队列的队尾偷，队尾是排在最后、耗时最短的任务
+    int n = (int)queues_.size();
+    for (int i = 1; i < n; i++) {
+        TaskQueue &victim = *queues_[(id + i) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void ThreadPool::drain(int id) {
+    int task;
+    while (popTask(id, task)) {
+        task_(task);
+        if (remaining_.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_.notify_all();
+        }
+    }
+}
+
+
+void ThreadPool::workerLoop(int id) {
+    unsigned long seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_) return;
+            seen = generation_;
+        }
+        drain(id);
+    }
+}
+
+
+void ThreadPool::run(int nTasks, const std::function<void(int)> &task) {
+    if (nTasks <= 0) return;
+    if (workers_.empty()) {
+        for (int i = 0; i < nTasks; i++) task(i);
+        return;
+    }
+
+    task_ = task;
+    remaining_ = nTasks;
+    int n = (int)queues_.size();
+    for (int i = 0; i < nTasks; i++) {
+        TaskQueue &q = *queues_[i % n];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.tasks.push_back(i);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        generation_++;
+    }
+    wake_.notify_all();
+
+    drain(0);
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [&] { return remaining_.load() == 0; });
+}
+
+
+void ThreadPool::parallelFor(int begin, int end, const std::function<void(int)> &body, int grain) {
+    int count = end - begin;
+    if (count <= 0) return;
+    grain = std::max(grain, 1);
+    int nChunks = (count + grain - 1) / grain;
+    run(nChunks, [&](int chunk) {
+        int first = begin + chunk * grain;
+        int last = std::min(first + grain, end);
+        for (int i = first; i < last; i++) body(i);
+    });
+}
+
+
+ThreadPool &defaultThreadPool() {
+    static ThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,62 @@
+﻿#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/*
+    常驻线程池，每个线程一个任务队列，自己的队列空了就去偷别人的
+    run() 阻塞到所有任务完成，调用线程也参与执行
+*/
+class ThreadPool {
+public:
+    /// \param nThreads 参与执行的线程总数（含调用线程），<= 0 时取硬件线程数
+    explicit ThreadPool(int nThreads = 0);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    [[nodiscard]] int nThreads() const { return (int)queues_.size(); }
+
+    /// 执行任务 0..nTasks-1，按顺序轮流分给各线程的队列，
+    /// 先入队的任务先执行，所以耗时长的任务应该排在前面
+    void run(int nTasks, const std::function<void(int)> &task);
+
+    /// 把 [begin, end) 切成若干块并行执行 body(i)
+    void parallelFor(int begin, int end, const std::function<void(int)> &body, int grain = 1);
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    void workerLoop(int id);
+    bool popTask(int id, int &task);
+    void drain(int id);
+
+    std::vector<std::unique_ptr<TaskQueue>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::function<void(int)> task_;
+    unsigned long generation_ = 0;
+    std::atomic<int> remaining_{0};
+    bool stop_ = false;
+};
+
+/// 进程内共享的默认线程池
+ThreadPool &defaultThreadPool();
+
+#endif //PARALLEL_H_
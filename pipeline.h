@@ -0,0 +1,421 @@
+﻿#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "clip.h"
+#include "cull.h"
+#include "depthbuffer.h"
+#include "framebuffer.h"
+#include "image.h"
+#include "mvp.h"
+#include "raster.h"
+#include "rasterimpl.h"
+#include "render.h"
+#include "shader.h"
+#include "varyings.h"
+#include "vertex.h"
+
+
+/*
+    可编程管线
+    流程和原来的固定管线相同：顶点阶段 -> 视锥剔除和裁剪 -> 背面剔除 -> setup -> 分块并行光栅化，
+    只是顶点和片元阶段换成着色器的 vertex()/fragment()，见 shader.h
+    着色器类型是模板参数，光栅化循环按着色器和像素格式各实例化一份，fragment() 内联在最内层
+    varyings 只存着色器声明的 VARYINGS 个：顶点阶段每个顶点一份，setup 时每个三角形算一次平面方程，
+    光栅化时透视矫正插值，AVX2 路径一次插值 8 个像素，见 varyings.h
+*/
+
+/// setup 之后每个三角形的着色数据，和 tiler 里的三角形按下标对应
+template <class Shader>
+struct ShadedTriangle {
+    typename Shader::Flat flat;
+    VaryingPlanes<Shader::VARYINGS> planes;
+};
+
+
+/*
+    光栅化的输出目标，通过深度测试的像素交给 target.shade()：调用 fragment()、写结果，被丢弃时返回 false
+    fragment() 的输出类型由目标决定，颜色缓冲是 TGAColor，G-buffer 见 deferred.h
+*/
+template <class Format>
+struct ColorTarget {
+    ImageView<Format> image;
+
+    template <class Shader>
+    bool shade(const Shader &shader, const typename Shader::Flat &flat, Varyings in, int x, int y) const {
+        TGAColor color;
+        if (!shader.fragment(flat, in, color)) return false;
+        image.at(x, y) = Format::pack(color.r, color.g, color.b, color.a);
+        return true;
+    }
+};
+
+template <class Format>
+inline ColorTarget<Format> colorTarget(ImageView<Format> image) {
+    return {image};
+}
+
+
+/// 包围盒按 8x8 块遍历，先用层次深度缓冲整块剔除，逐像素的深度测试放在插值和着色之前
+/// 着色器要偏导时，每个 2x2 像素块第一个通过深度测试的像素算一次，块里其余像素共用
+template <class Target, class Shader>
+void rasterizeShadedScalar(const Target &target, DepthBuffer &depth, const RasterTriangle &tri,
+                           const Shader &shader, const ShadedTriangle<Shader> &data, DepthTest test) {
+    if (coarseRejected(depth, tri)) return;
+    constexpr int N = Shader::VARYINGS, D = Shader::DERIVATIVES;
+    const int B = DepthBuffer::BLOCK;
+    float in[N > 0 ? N : 1];
+    float ddx[D > 0 ? D : 1], ddy[D > 0 ? D : 1];
+    RowSpanner spanner(tri);
+    BlockRowSpans spans;
+    for (int by = tri.minY / B; by <= (tri.maxY - 1) / B; by++) {
+        int y0 = std::max(by * B, tri.minY), y1 = std::min(by * B + B, tri.maxY);
+        if (!nextBlockRow(spanner, tri, y0, y1, spans)) continue;
+
+        for (int bx = spans.minX / B; bx <= (spans.maxX - 1) / B; bx++) {
+            int x0 = std::max(bx * B, tri.minX), x1 = std::min(bx * B + B, tri.maxX);
+            DepthRange range = depthRange(tri, x0, x1, y0, y1);
+            if (range.hi <= depth.blockMin(bx, by)) continue;  // 整块被遮挡
+            bool allPass = range.lo > depth.blockMax(bx, by);   // 整块都在已有深度之前
+
+            bool written = false;
+            for (int y = y0; y < y1; y++) {
+                int xs = std::max(spans.x0[y - y0], x0), xe = std::min(spans.x1[y - y0], x1);
+                float dy = (float)y + 0.5f - tri.y0;
+                float *zrow = depth.row(y);
+                int quad = -1;  // 偏导已经算过的 2x2 像素块的列号
+                for (int x = xs; x < xe; x++) {
+                    float dx = (float)x + 0.5f - tri.x0;
+                    float l1 = tri.a1 * dx + tri.b1 * dy;
+                    float l2 = tri.a2 * dx + tri.b2 * dy;
+                    float l0 = 1.f - l1 - l2;
+
+                    float z = pixelDepth(tri, l0, l1, l2);
+                    if (!allPass && !depthPasses(z, zrow[x], test)) continue;
+                    interpolatePlanes(data.planes, dx, dy, in);
+                    if constexpr (D > 0) {
+                        if ((x >> 1) != quad) {
+                            quad = x >> 1;
+                            planeDerivatives<D>(data.planes, quadOffset(x, tri.x0), quadOffset(y, tri.y0), ddx, ddy);
+                        }
+                    }
+                    if (!target.shade(shader, data.flat, Varyings(in, 1, ddx, ddy), x, y)) continue;
+                    zrow[x] = z;
+                    written = true;
+                }
+            }
+            if (written) depth.updateBlock(bx, by);
+        }
+    }
+}
+
+
+#ifdef TR_X86
+
+template <class Target, class Shader>
+TR_TARGET_AVX2 void rasterizeShadedAVX2(const Target &target, DepthBuffer &depth, const RasterTriangle &tri,
+                                        const Shader &shader, const ShadedTriangle<Shader> &data, DepthTest test) {
+    if (coarseRejected(depth, tri)) return;
+    constexpr int N = Shader::VARYINGS, D = Shader::DERIVATIVES;
+    const int B = DepthBuffer::BLOCK;
+    static_assert(DepthBuffer::BLOCK == 8, "one block row is one 8-lane chunk");
+    alignas(32) float in[N > 0 ? N : 1][8];  // 8 个像素的 varyings，按属性分组
+    alignas(32) float ddx[D > 0 ? D : 1][8], ddy[D > 0 ? D : 1][8];  // 每个通道所在 2x2 像素块的偏导
+    // 覆盖区间和标量实现一样逐行求，每个块的一行正好是对齐的 8 个通道，区间外的通道不参与
+    RowSpanner spanner(tri);
+    BlockRowSpans spans;
+    for (int by = tri.minY / B; by <= (tri.maxY - 1) / B; by++) {
+        int y0 = std::max(by * B, tri.minY), y1 = std::min(by * B + B, tri.maxY);
+        if (!nextBlockRow(spanner, tri, y0, y1, spans)) continue;
+
+        for (int bx = spans.minX / B; bx <= (spans.maxX - 1) / B; bx++) {
+            int xBase = bx * B;
+            int x0 = std::max(xBase, tri.minX), x1 = std::min(xBase + B, tri.maxX);
+            DepthRange range = depthRange(tri, x0, x1, y0, y1);
+            if (range.hi <= depth.blockMin(bx, by)) continue;  // 整块被遮挡
+            bool allPass = range.lo > depth.blockMax(bx, by);   // 整块都在已有深度之前
+
+            bool written = false;
+            for (int y = y0; y < y1; y++) {
+                int xs = std::max(spans.x0[y - y0], x0), xe = std::min(spans.x1[y - y0], x1);
+                if (xs >= xe) continue;
+                int mask = laneRange(xBase, xs, xe);
+                __m256 dx = pixelDx8(tri, xBase), l1, l2, l0;
+                float dy = (float)y + 0.5f - tri.y0;
+                barycentric8(tri, dx, dy, l1, l2, l0);
+
+                // 8 个通道一起插值深度并做深度测试，通过的才插值 varyings 和着色
+                __m256 z = pixelDepth8(tri, l0, l1, l2);
+                float *zrow = depth.row(y) + xBase;
+                if (!allPass) {
+                    __m256 stored = _mm256_maskload_ps(zrow, laneMask8(mask));
+                    mask &= depthPassMask8(z, stored, test);
+                    if (!mask) continue;
+                }
+
+                interpolatePlanes8(data.planes, dx, dy, in);
+                if constexpr (D > 0)
+                    planeDerivatives8<D>(data.planes, quadDx8(tri, xBase), quadOffset(y, tri.y0), ddx, ddy);
+                int kept = 0;  // 没被 fragment() 丢弃的通道
+                for (int m = mask; m; m &= m - 1) {
+                    int lane = firstLane(m);
+                    Varyings in8(&in[0][lane], 8, &ddx[0][lane], &ddy[0][lane]);
+                    if (target.shade(shader, data.flat, in8, xBase + lane, y))
+                        kept |= 1 << lane;
+                }
+                if (!kept) continue;
+                _mm256_maskstore_ps(zrow, laneMask8(kept), z);
+                written = true;
+            }
+            if (written) depth.updateBlock(bx, by);
+        }
+    }
+}
+
+#endif // TR_X86
+
+
+/// 带深度测试、用着色器着色的三角形，按 activeRasterPath() 选择实现
+/// \param target 输出目标，例如 colorTarget(view)
+template <class Target, class Shader>
+void rasterizeShaded(const Target &target, DepthBuffer &depth, const RasterTriangle &tri, const Shader &shader,
+                     const ShadedTriangle<Shader> &data, DepthTest test = DepthTest::Greater) {
+#ifdef TR_X86
+    if (activeRasterPath() == RasterPath::AVX2) {
+        rasterizeShadedAVX2(target, depth, tri, shader, data, test);
+        return;
+    }
+#endif
+    rasterizeShadedScalar(target, depth, tri, shader, data, test);
+}
+
+
+/// 在字节缓冲末尾放一个 Record，缓冲由 std::allocator 分配，按基本类型的最大对齐
+template <class Record>
+inline Record *appendRecord(std::vector<unsigned char> &buffer) {
+    static_assert(alignof(Record) <= alignof(std::max_align_t) && sizeof(Record) % alignof(Record) == 0,
+                  "records must stay aligned when packed back to back");
+    static_assert(std::is_trivially_destructible<Record>::value, "the buffer is cleared without destructors");
+    size_t offset = buffer.size();
+    buffer.resize(offset + sizeof(Record));
+    return new (buffer.data() + offset) Record;
+}
+
+inline ScreenBounds screenBounds(int width, int height) {
+    return {(float)width, (float)height, (float)VIEWPORT_DEPTH, GUARD_BAND};
+}
+
+
+/// 顶点阶段、剔除、裁剪和三角形 setup，结果放进 state.tiler 和 state.shading
+/// \tparam Shading 为 false 时只要位置，给 drawMeshDepth() 用：vertex() 写出的 varyings 不保存、裁剪时不插值，
+///         不调用 triangle()，state.shading 为空；顶点阶段还是同一个 vertex()，深度和着色时逐位相同
+template <bool Shading = true, class Shader>
+void setupMesh(int width, int height, const Shader &shader, int nVerts, const int *faces, int nFaces,
+               RenderState &state) {
+    static_assert(std::is_base_of<IShader<Shader, Shader::VARYINGS, typename Shader::Flat>, Shader>::value,
+                  "shaders derive from IShader<Shader, ...>");
+    static_assert(Shader::DERIVATIVES >= 0 && Shader::DERIVATIVES <= Shader::VARYINGS,
+                  "derivatives are taken of the first DERIVATIVES varyings");
+    constexpr int N = Shader::VARYINGS;
+    constexpr int KEPT = Shading ? N : 0;  // 保存和插值的 varying 个数
+    using Record = ShadedTriangle<Shader>;
+
+    CullStats &stats = state.cullStats;
+    stats = CullStats();
+    stats.input = nFaces;
+    state.tiler.begin(width, height);
+    state.shading.clear();
+    ScreenBounds bounds = screenBounds(width, height);
+
+    // 顶点阶段：每个顶点只调用一次 vertex()
+    ScreenVertices &screen = state.screen;
+    screen.resize(nVerts);
+    screen.varyings.resize((size_t)nVerts * KEPT);
+    float *ox = screen.x.data(), *oy = screen.y.data(), *oz = screen.z.data(), *ow = screen.invW.data();
+    unsigned char *oc = screen.clip.data();
+    float *varyings = screen.varyings.data();
+    float unused[N > 0 ? N : 1];
+    for (int i = 0; i < nVerts; i++) {
+        Vec4f c = shader.vertex(i, Shading ? varyings + (size_t)i * N : unused);
+        float invW = 1.f / c.w;
+        ox[i] = c.x * invW;
+        oy[i] = c.y * invW;
+        oz[i] = c.z * invW;
+        ow[i] = invW;
+        oc[i] = clipBits(ox[i], oy[i], oz[i], c.w, bounds);
+    }
+
+    // 背面剔除、setup 和逐三角形的着色器计算，裁剪前后的三角形共用
+    RasterTriangle tri;
+    auto submit = [&](int face, const Vec3f *pts, const float *const *vars, const float *invW) {
+        Vec3f n = cross(pts[2] - pts[0], pts[1] - pts[0]);
+        if (isBackFace(-n.z, state.cull)) {
+            stats.backFace++;
+            return;
+        }
+        if (!setupTriangle(pts, width, height, tri)) {
+            stats.empty++;
+            return;
+        }
+
+        if constexpr (Shading) {
+            Record *record = appendRecord<Record>(state.shading);
+            setupPlanes(tri, vars, invW, record->planes);
+            record->flat = shader.triangle(face, pts);
+        }
+        state.tiler.add(tri);
+        stats.rasterized++;
+    };
+
+    const unsigned char *clip = screen.clip.data();
+    Vec3f pts[3];
+    const float *vars[3];
+    float invW[3];
+    for (int i = 0; i < nFaces; i++) {
+        const int *face = faces + (size_t)i * 3;
+        unsigned char c0 = clip[face[0]], c1 = clip[face[1]], c2 = clip[face[2]];
+        if (c0 & c1 & c2 & ~CLIP_GUARD) {
+            stats.frustum++;
+            continue;
+        }
+
+        if (!needsClipping(c0 | c1 | c2, state.clip)) {
+            for (int j = 0; j < 3; j++) {
+                pts[j] = screen.pos(face[j]);
+                vars[j] = varyings + (size_t)face[j] * KEPT;
+                invW[j] = ow[face[j]];
+            }
+            submit(i, pts, vars, invW);
+            continue;
+        }
+
+        // 跨近平面或超出保护带：在透视除法之前裁剪，裁出的凸多边形按扇形重新三角化
+        // 裁剪空间坐标没有保存，这几个顶点重新跑一遍顶点阶段
+        stats.clipped++;
+        ClipVertex in[3], poly[MAX_CLIP_VERTS];
+        for (int j = 0; j < 3; j++) {
+            Vec4f c = shader.vertex(face[j], in[j].varyings);
+            in[j].x = c.x;
+            in[j].y = c.y;
+            in[j].z = c.z;
+            in[j].w = c.w;
+        }
+        int n = clipTriangle(in, KEPT, bounds, state.clip, poly);
+        Vec3f polyPts[MAX_CLIP_VERTS];
+        float polyInvW[MAX_CLIP_VERTS];
+        for (int k = 0; k < n; k++) {
+            polyInvW[k] = 1.f / poly[k].w;
+            polyPts[k] = Vec3f(poly[k].x * polyInvW[k], poly[k].y * polyInvW[k], poly[k].z * polyInvW[k]);
+        }
+        for (int k = 1; k + 1 < n; k++) {
+            pts[0] = polyPts[0], pts[1] = polyPts[k], pts[2] = polyPts[k + 1];
+            vars[0] = poly[0].varyings, vars[1] = poly[k].varyings, vars[2] = poly[k + 1].varyings;
+            invW[0] = polyInvW[0], invW[1] = polyInvW[k], invW[2] = polyInvW[k + 1];
+            submit(i, pts, vars, invW);
+        }
+    }
+}
+
+
+/// 分块并行光栅化 setupMesh() 的结果
+/// \param fb 非空时按 tile 延迟清屏
+template <class Target, class Shader>
+void flushMesh(const Target &target, DepthBuffer &depth, Framebuffer *fb, const Shader &shader, RenderState &state,
+               DepthTest test = DepthTest::Greater) {
+    const auto *records = reinterpret_cast<const ShadedTriangle<Shader> *>(state.shading.data());
+    state.tiler.flush(state.pool, fb, [&](const RasterTriangle &tri, int idx) {
+        rasterizeShaded(target, depth, tri, shader, records[idx], test);
+    });
+}
+
+
+/*
+    只写深度的一遍：顶点阶段、剔除和裁剪和 drawMesh() 相同，setup 不算 varyings 的平面方程、不调用 triangle()，
+    光栅化换成 raster.h 的 rasterizeDepth()，没有颜色、插值和纹理
+    阴影贴图、深度预渲染 (z-prepass) 和遮挡测试都用它；shader 只用到 vertex()，
+    可以是 DepthShader，也可以是之后着色的那个着色器，这时两遍的深度逐位相同
+*/
+
+/// \param fb 非空时按 tile 延迟清屏，depth 必须是 fb->depth()
+template <class Shader>
+void drawMeshDepth(DepthBuffer &depth, Framebuffer *fb, const Shader &shader, int nVerts, const int *faces,
+                   int nFaces, RenderState &state) {
+    setupMesh<false>(depth.width(), depth.height(), shader, nVerts, faces, nFaces, state);
+    state.tiler.flush(state.pool, fb, [&](const RasterTriangle &tri, int) { rasterizeDepth(depth, tri); });
+}
+
+/// drawMesh() 之前的深度预渲染，之后的着色用 DepthTest::GreaterEqual
+/// 深度预渲染不调用 fragment()，会丢弃像素的着色器 (Shader::DISCARDS) 画出的深度不对，跳过
+template <class Shader>
+DepthTest depthPrepass(DepthBuffer &depth, Framebuffer *fb, const Shader &shader, int nVerts, const int *faces,
+                       int nFaces, RenderState &state) {
+    if (!state.depthPrepass || Shader::DISCARDS) return DepthTest::Greater;
+    drawMeshDepth(depth, fb, shader, nVerts, faces, nFaces, state);
+    return DepthTest::GreaterEqual;
+}
+
+
+/// 用着色器画一个索引三角形网格
+/// \param shader 顶点和片元阶段，见 shader.h
+/// \param nVerts 顶点数，顶点阶段对 [0, nVerts) 的每个下标调用一次 shader.vertex()
+/// \param faces 每个三角形 3 个顶点下标
+/// \param nFaces 三角形数
+/// \return fb 的像素格式不支持时返回 false
+/// state.depthPrepass 打开、且 shader 不会丢弃像素时先用 drawMeshDepth() 画一遍深度
+template <class Shader>
+bool drawMesh(Framebuffer &fb, const Shader &shader, int nVerts, const int *faces, int nFaces, RenderState &state) {
+    DepthTest test = depthPrepass(fb.depth(), &fb, shader, nVerts, faces, nFaces, state);
+    setupMesh(fb.width(), fb.height(), shader, nVerts, faces, nFaces, state);
+    return visitColorView(fb.color(), [&](auto view) {
+        flushMesh(colorTarget(view), fb.depth(), &fb, shader, state, test);
+    });
+}
+
+/// 同上，画到颜色缓冲 image 和同样大小的深度缓冲 depth
+template <class Shader>
+bool drawMesh(TGAImage &image, DepthBuffer &depth, const Shader &shader, int nVerts, const int *faces, int nFaces,
+              RenderState &state) {
+    DepthTest test = depthPrepass(depth, nullptr, shader, nVerts, faces, nFaces, state);
+    setupMesh(image.get_width(), image.get_height(), shader, nVerts, faces, nFaces, state);
+    return visitColorView(image, [&](auto view) { flushMesh(colorTarget(view), depth, nullptr, shader, state, test); });
+}
+
+
+/// 模型包围盒经 shader.mvp() 变换后整个在视锥外时，记下剔除统计并返回 true
+template <class Shader>
+bool modelOutsideFrustum(int width, int height, Model *model, const Shader &shader, RenderState &state) {
+    if (!boxOutsideFrustum(shader.mvp(), model->bboxMin(), model->bboxMax(), screenBounds(width, height)))
+        return false;
+    state.cullStats = CullStats();
+    state.cullStats.input = state.cullStats.object = model->nFaces();
+    return true;
+}
+
+/// 画整个模型，先用 shader.mvp() 和模型包围盒做整体的视锥剔除
+/// vertex() 不是用 mvp() 变换模型顶点时（蒙皮、顶点动画），包围盒不可靠，改用 drawMesh()
+template <class Shader>
+bool drawModel(Framebuffer &fb, Model *model, const Shader &shader, RenderState &state) {
+    if (modelOutsideFrustum(fb.width(), fb.height(), model, shader, state)) return true;
+    return drawMesh(fb, shader, model->nVert(), model->indices(), model->nFaces(), state);
+}
+
+template <class Shader>
+bool drawModel(TGAImage &image, DepthBuffer &depth, Model *model, const Shader &shader, RenderState &state) {
+    if (modelOutsideFrustum(image.get_width(), image.get_height(), model, shader, state)) return true;
+    return drawMesh(image, depth, shader, model->nVert(), model->indices(), model->nFaces(), state);
+}
+
+/// 只画深度，先用 shader.mvp() 和模型包围盒做整体的视锥剔除
+/// \param fb 非空时按 tile 延迟清屏，depth 必须是 fb->depth()
+template <class Shader>
+void drawModelDepth(DepthBuffer &depth, Framebuffer *fb, Model *model, const Shader &shader, RenderState &state) {
+    if (modelOutsideFrustum(depth.width(), depth.height(), model, shader, state)) return;
+    drawMeshDepth(depth, fb, shader, model->nVert(), model->indices(), model->nFaces(), state);
+}
+
+#endif //PIPELINE_H_
@@ -0,0 +1,258 @@
+﻿#include "raster.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "rasterimpl.h"
+
+
+bool setupTriangle(const Vec3f *v, int width, int height, RasterTriangle &tri) {
+    // 顶点吸附到定点网格，之后的覆盖测试都用整数
+    int32_t fx[3], fy[3];
+    for (int i = 0; i < 3; i++) {
+        if (!(std::abs(v[i].x) < MAX_RASTER_COORD && std::abs(v[i].y) < MAX_RASTER_COORD)) return false;
+        fx[i] = (int32_t)std::lround(v[i].x * SUBPIXEL_ONE);
+        fy[i] = (int32_t)std::lround(v[i].y * SUBPIXEL_ONE);
+    }
+    // 有向面积的两倍，吸附后为 0 的三角形不覆盖任何像素；面积再小也不丢，否则细长三角形之间会漏缝
+    int64_t area2 = (int64_t)(fx[1] - fx[0]) * (fy[2] - fy[0]) - (int64_t)(fy[1] - fy[0]) * (fx[2] - fx[0]);
+    if (area2 == 0) return false;
+
+    // 包围盒只取中心 (x + 0.5, y + 0.5) 落在里面的像素，一个像素中心都不含的小三角形直接丢弃
+    const int32_t half = SUBPIXEL_ONE / 2;
+    tri.minX = std::max((min(fx[0], fx[1], fx[2]) - half + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS, 0);
+    tri.maxX = std::min(((max(fx[0], fx[1], fx[2]) - half) >> SUBPIXEL_BITS) + 1, width);
+    tri.minY = std::max((min(fy[0], fy[1], fy[2]) - half + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS, 0);
+    tri.maxY = std::min(((max(fy[0], fy[1], fy[2]) - half) >> SUBPIXEL_BITS) + 1, height);
+    if (tri.minX >= tri.maxX || tri.minY >= tri.maxY) return false;
+
+    // 第 i 条边从顶点 j 到 k，E_i 在顶点 i 处等于 area2，乘上面积的符号后内部为正
+    // top-left 规则：内部在边的右侧 (a > 0，左边) 或水平边的内部在 y 更大的一侧 (上边) 时，E == 0 算覆盖，
+    // 其余的边 E == 0 不算，公共边两侧的三角形正好一个包含、一个不包含
+    int32_t sign = area2 > 0 ? 1 : -1;
+    for (int i = 0; i < 3; i++) {
+        int j = (i + 1) % 3, k = (i + 2) % 3;
+        EdgeFunction &e = tri.edge[i];
+        e.a = (fy[j] - fy[k]) * sign;
+        e.b = (fx[k] - fx[j]) * sign;
+        e.c = -((int64_t)e.a * fx[j] + (int64_t)e.b * fy[j]);
+        bool topLeft = e.a > 0 || (e.a == 0 && e.b > 0);
+        if (!topLeft) e.c -= 1;
+    }
+
+    // 插值和覆盖测试用同一组吸附后的顶点
+    float sx[3], sy[3];
+    for (int i = 0; i < 3; i++) {
+        sx[i] = (float)fx[i] / SUBPIXEL_ONE;
+        sy[i] = (float)fy[i] / SUBPIXEL_ONE;
+    }
+    float e1x = sx[1] - sx[0], e1y = sy[1] - sy[0];
+    float e2x = sx[2] - sx[0], e2y = sy[2] - sy[0];
+    float inv = 1.f / (e2x * e1y - e1x * e2y);
+    tri.x0 = sx[0];
+    tri.y0 = sy[0];
+    tri.a1 = -e2y * inv;
+    tri.b1 = e2x * inv;
+    tri.a2 = e1y * inv;
+    tri.b2 = -e1x * inv;
+    for (int i = 0; i < 3; i++) tri.z[i] = v[i].z;
+    tri.zdx = (v[1].z - v[0].z) * tri.a1 + (v[2].z - v[0].z) * tri.a2;
+    tri.zdy = (v[1].z - v[0].z) * tri.b1 + (v[2].z - v[0].z) * tri.b2;
+    tri.zMin = min(v[0].z, v[1].z, v[2].z);
+    tri.zMax = max(v[0].z, v[1].z, v[2].z);
+    return true;
+}
+
+
+template <class Format>
+static void fillTriangleScalar(ImageView<Format> image, const RasterTriangle &tri, typename Format::Pixel color) {
+    RowSpanner spanner(tri);
+    for (int y = tri.minY; y < tri.maxY; y++) {
+        int x0, x1;
+        spanner.next(x0, x1);
+        auto *row = image.row(y);
+        for (int x = x0; x < x1; x++) row[x] = color;
+    }
+}
+
+
+/// 和 pipeline.h 的 rasterizeShadedScalar() 相同的遍历，去掉了插值和着色
+static void rasterizeDepthScalar(DepthBuffer &depth, const RasterTriangle &tri) {
+    if (coarseRejected(depth, tri)) return;
+    const int B = DepthBuffer::BLOCK;
+    RowSpanner spanner(tri);
+    BlockRowSpans spans;
+    for (int by = tri.minY / B; by <= (tri.maxY - 1) / B; by++) {
+        int y0 = std::max(by * B, tri.minY), y1 = std::min(by * B + B, tri.maxY);
+        if (!nextBlockRow(spanner, tri, y0, y1, spans)) continue;
+
+        for (int bx = spans.minX / B; bx <= (spans.maxX - 1) / B; bx++) {
+            int x0 = std::max(bx * B, tri.minX), x1 = std::min(bx * B + B, tri.maxX);
+            DepthRange range = depthRange(tri, x0, x1, y0, y1);
+            if (range.hi <= depth.blockMin(bx, by)) continue;
+            bool allPass = range.lo > depth.blockMax(bx, by);
+
+            bool written = false;
+            for (int y = y0; y < y1; y++) {
+                int xs = std::max(spans.x0[y - y0], x0), xe = std::min(spans.x1[y - y0], x1);
+                float dy = (float)y + 0.5f - tri.y0;
+                float *zrow = depth.row(y);
+                for (int x = xs; x < xe; x++) {
+                    float dx = (float)x + 0.5f - tri.x0;
+                    float l1 = tri.a1 * dx + tri.b1 * dy;
+                    float l2 = tri.a2 * dx + tri.b2 * dy;
+                    float z = pixelDepth(tri, 1.f - l1 - l2, l1, l2);
+                    if (!allPass && !depthPasses(z, zrow[x], DepthTest::Greater)) continue;
+                    zrow[x] = z;
+                    written = true;
+                }
+            }
+            if (written) depth.updateBlock(bx, by);
+        }
+    }
+}
+
+
+#ifdef TR_X86
+
+/// 覆盖区间和标量实现一样由 RowSpanner 求出，区间里每个像素都被覆盖，不用再测试；
+/// 区间按 32 个像素一组用 256 位存储整块写，1、3、4 字节的像素格式 32 个正好是 32 字节的整数倍
+template <class Format>
+TR_TARGET_AVX2 static void fillTriangleAVX2(ImageView<Format> image, const RasterTriangle &tri,
+                                            typename Format::Pixel color) {
+    using Pixel = typename Format::Pixel;
+    constexpr int RUN = 32;
+    constexpr int VECTORS = RUN * (int)sizeof(Pixel) / 32;
+    static_assert(RUN * sizeof(Pixel) % 32 == 0, "a run of pixels must be whole 256-bit vectors");
+    if (tri.maxX - tri.minX < RUN) {
+        fillTriangleScalar(image, tri, color);  // 没有一行放得下一整组，省掉准备整组像素的开销
+        return;
+    }
+    alignas(32) Pixel pattern[RUN];
+    std::fill(pattern, pattern + RUN, color);
+    __m256i run[VECTORS];
+    for (int i = 0; i < VECTORS; i++) run[i] = _mm256_load_si256(reinterpret_cast<const __m256i *>(pattern) + i);
+
+    RowSpanner spanner(tri);
+    for (int y = tri.minY; y < tri.maxY; y++) {
+        int x0, x1;
+        spanner.next(x0, x1);
+        Pixel *row = image.row(y);
+        int x = x0;
+        for (; x + RUN <= x1; x += RUN) {
+            __m256i *out = reinterpret_cast<__m256i *>(row + x);
+            for (int i = 0; i < VECTORS; i++) _mm256_storeu_si256(out + i, run[i]);
+        }
+        for (; x < x1; x++) row[x] = color;
+    }
+}
+
+
+TR_TARGET_AVX2 static void rasterizeDepthAVX2(DepthBuffer &depth, const RasterTriangle &tri) {
+    if (coarseRejected(depth, tri)) return;
+    const int B = DepthBuffer::BLOCK;
+    RowSpanner spanner(tri);
+    BlockRowSpans spans;
+    for (int by = tri.minY / B; by <= (tri.maxY - 1) / B; by++) {
+        int y0 = std::max(by * B, tri.minY), y1 = std::min(by * B + B, tri.maxY);
+        if (!nextBlockRow(spanner, tri, y0, y1, spans)) continue;
+
+        for (int bx = spans.minX / B; bx <= (spans.maxX - 1) / B; bx++) {
+            int xBase = bx * B;
+            int x0 = std::max(xBase, tri.minX), x1 = std::min(xBase + B, tri.maxX);
+            DepthRange range = depthRange(tri, x0, x1, y0, y1);
+            if (range.hi <= depth.blockMin(bx, by)) continue;
+            bool allPass = range.lo > depth.blockMax(bx, by);
+
+            bool written = false;
+            for (int y = y0; y < y1; y++) {
+                int xs = std::max(spans.x0[y - y0], x0), xe = std::min(spans.x1[y - y0], x1);
+                if (xs >= xe) continue;
+                int mask = laneRange(xBase, xs, xe);
+                __m256 l1, l2, l0;
+                barycentric8(tri, pixelDx8(tri, xBase), (float)y + 0.5f - tri.y0, l1, l2, l0);
+                __m256 z = pixelDepth8(tri, l0, l1, l2);
+                float *zrow = depth.row(y) + xBase;
+                if (!allPass) {
+                    mask &= depthPassMask8(z, _mm256_maskload_ps(zrow, laneMask8(mask)), DepthTest::Greater);
+                    if (!mask) continue;
+                }
+                _mm256_maskstore_ps(zrow, laneMask8(mask), z);
+                written = true;
+            }
+            if (written) depth.updateBlock(bx, by);
+        }
+    }
+}
+
+
+static bool cpuSupportsAVX2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false;  // 操作系统需保存 ymm 寄存器
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // TR_X86
+
+
+static RasterPath detectRasterPath() {
+#ifdef TR_X86
+    if (cpuSupportsAVX2()) return RasterPath::AVX2;
+#endif
+    return RasterPath::Scalar;
+}
+
+static RasterPath gRasterPath = detectRasterPath();
+
+
+RasterPath activeRasterPath() { return gRasterPath; }
+
+RasterPath setRasterPath(RasterPath path) {
+    gRasterPath = (path == RasterPath::AVX2) ? detectRasterPath() : RasterPath::Scalar;
+    return gRasterPath;
+}
+
+const char *rasterPathName(RasterPath path) {
+    switch (path) {
+        case RasterPath::AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+
+template <class Format>
+void fillTriangle(ImageView<Format> image, const RasterTriangle &tri, typename Format::Pixel color) {
+#ifdef TR_X86
+    if (gRasterPath == RasterPath::AVX2) {
+        fillTriangleAVX2(image, tri, color);
+        return;
+    }
+#endif
+    fillTriangleScalar(image, tri, color);
+}
+
+
+void rasterizeDepth(DepthBuffer &depth, const RasterTriangle &tri) {
+#ifdef TR_X86
+    if (gRasterPath == RasterPath::AVX2) {
+        rasterizeDepthAVX2(depth, tri);
+        return;
+    }
+#endif
+    rasterizeDepthScalar(depth, tri);
+}
+
+
+template void fillTriangle(ImageView<Gray8>, const RasterTriangle &, Gray8::Pixel);
+template void fillTriangle(ImageView<RGB8>, const RasterTriangle &, RGB8::Pixel);
+template void fillTriangle(ImageView<RGBA8>, const RasterTriangle &, RGBA8::Pixel);
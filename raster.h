@@ -0,0 +1,80 @@
+﻿#ifndef RASTER_H_
+#define RASTER_H_
+
+#include <cstdint>
+
+#include "GMath.h"
+#include "depthbuffer.h"
+#include "image.h"
+#include "model.h"
+#include "tgaimage.h"
+
+
+/*
+    基于边函数 (edge function) 的三角形光栅化
+    覆盖测试用定点数：顶点吸附到 1/16 像素的网格，三条边函数都是整数，结果精确，
+    再按 top-left 规则处理正好落在边上的像素中心，相邻三角形的公共边上每个像素只画一次，没有缝也不会重复
+    插值用浮点：每个三角形先做一次 setup，把重心坐标写成屏幕坐标的线性函数：
+        λ1 = a1 * (x - x0) + b1 * (y - y0)
+        λ2 = a2 * (x - x0) + b2 * (y - y0)
+        λ0 = 1 - λ1 - λ2
+    逐像素只剩乘加，不再像 barycentric() 那样每个像素做叉积和三次除法
+    覆盖区间逐行求出 (rasterimpl.h 的 RowSpanner)，包围盒里空着的角不走；
+    AVX2 在区间里一次插值、深度测试 8 个像素，CPU 不支持时运行时退回标量实现
+    这里只管几何：覆盖、深度平面和包围盒；varyings 的插值和着色由 pipeline.h 按着色器类型生成
+*/
+
+/// 顶点坐标的小数位数
+constexpr int SUBPIXEL_BITS = 4;
+constexpr int SUBPIXEL_ONE = 1 << SUBPIXEL_BITS;
+
+/// 能光栅化的最大坐标绝对值（像素），更远的三角形要先裁剪，见 clip.h 的保护带
+/// 在这个范围内定点边函数按像素步进时 int32 不会溢出
+constexpr float MAX_RASTER_COORD = 32768.0f;
+
+/// 定点边函数 E(X, Y) = a * X + b * Y + c，X/Y 是以 1/SUBPIXEL_ONE 像素为单位的像素中心坐标
+/// 三角形内部为正，已经按 top-left 规则减掉偏置，E >= 0 就是覆盖
+struct EdgeFunction {
+    int32_t a, b;
+    int64_t c;
+};
+
+struct RasterTriangle {
+    EdgeFunction edge[3];  // 和 λ0/λ1/λ2 对应，第 i 条边是第 i 个顶点的对边
+    float x0, y0;          // 浮点插值的原点，取吸附后的第 0 个顶点
+    float a1, b1, a2, b2;  // 已除以有向面积的边函数系数
+    float z[3];
+    float zdx, zdy;        // 深度平面对 x/y 的偏导，估计块内深度范围
+    float zMin, zMax;      // 三个顶点的深度范围
+    int minX, maxX, minY, maxY;  // 包围盒，[min, max)，已裁剪到屏幕
+};
+
+/// 三角形 setup
+/// \param v 视口空间顶点
+/// \param width 屏幕宽，用于裁剪包围盒
+/// \param height 屏幕高
+/// \return 三角形退化（吸附到定点网格后面积为 0）、完全在屏幕外、不覆盖任何像素中心，
+///         或坐标超出 MAX_RASTER_COORD 时返回 false
+bool setupTriangle(const Vec3f *v, int width, int height, RasterTriangle &tri);
+
+/// 纯色填充，不做深度测试
+/// \param image 颜色缓冲，Gray8/RGB8/RGBA8 三种格式在 raster.cpp 中实例化
+template <class Format>
+void fillTriangle(ImageView<Format> image, const RasterTriangle &tri, typename Format::Pixel color);
+
+/// 只写深度：深度测试 (DepthTest::Greater) 和层次深度缓冲的剔除照常，没有颜色、varying 和纹理
+/// 阴影贴图、深度预渲染 (z-prepass) 和遮挡测试用，算出的深度和着色的光栅化逐位相同
+void rasterizeDepth(DepthBuffer &depth, const RasterTriangle &tri);
+
+
+enum class RasterPath { Scalar, AVX2 };
+
+/// 当前使用的光栅化实现，默认为 CPU 支持的最快实现
+RasterPath activeRasterPath();
+
+/// 强制切换实现，CPU 不支持时退回标量实现，返回实际生效的实现
+RasterPath setRasterPath(RasterPath path);
+
+const char *rasterPathName(RasterPath path);
+
+#endif //RASTER_H_
@@ -0,0 +1,147 @@
+﻿#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "draw.h"
+#include "image.h"
+#include "raster.h"
+
+/*
+    光栅化吞吐量测试，只做覆盖和写像素，不做深度和纹理
+    比较三种实现：
+        barycentric  原来 triangle() 的做法，包围盒里每个像素用 barycentric() 重新解一次重心坐标
+        scalar       定点边函数，按行递推，只走每行覆盖区间里的像素
+        avx2         定点边函数，一次测试 8 个像素（CPU 支持时）
+    三角形在屏幕上随机摆放，按外接圆半径分几档
+    加速比都相对 barycentric，最后一列是 avx2 相对 scalar，小于 1 说明 SIMD 路径反而更慢
+    用法: CPU_Render_RasterBench [-n triangles] [-w size]
+*/
+
+struct Options {
+    int triangles = 20000;  // 每档三角形个数
+    int size = 1024;        // 屏幕边长
+};
+
+static void usage(const char *exe) {
+    std::fprintf(stderr,
+                 "usage: %s [-n triangles] [-w size]\n"
+                 "  -n  triangles per size class (default 20000)\n"
+                 "  -w  width and height of the target image (default 1024)\n",
+                 exe);
+}
+
+static bool parseArgs(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!std::strcmp(arg, "-n") && hasValue) opt.triangles = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "-w") && hasValue) opt.size = std::atoi(argv[++i]);
+        else return false;
+    }
+    return opt.triangles > 0 && opt.size > 0;
+}
+
+struct Triangle {
+    Vec3f v[3];
+};
+
+/// 原来 triangle() 的内层循环
+static void fillBarycentric(ImageView<RGB8> image, const Triangle &t, RGB8::Pixel color) {
+    const Vec3f *v = t.v;
+    int minX = std::max(0, (int)std::floor(min(v[0].x, v[1].x, v[2].x)));
+    int maxX = std::min(image.width() - 1, (int)std::ceil(max(v[0].x, v[1].x, v[2].x)));
+    int minY = std::max(0, (int)std::floor(min(v[0].y, v[1].y, v[2].y)));
+    int maxY = std::min(image.height() - 1, (int)std::ceil(max(v[0].y, v[1].y, v[2].y)));
+    for (int y = minY; y <= maxY; y++) {
+        for (int x = minX; x <= maxX; x++) {
+            Vec3f bc = barycentric(v, Vec3f((float)x + 0.5f, (float)y + 0.5f, 0));
+            if (bc.x < 0 || bc.y < 0 || bc.z < 0) continue;
+            image.at(x, y) = color;
+        }
+    }
+}
+
+static void fillEdge(ImageView<RGB8> image, const Triangle &t, RGB8::Pixel color) {
+    RasterTriangle tri;
+    if (setupTriangle(t.v, image.width(), image.height(), tri)) fillTriangle(image, tri, color);
+}
+
+/// 返回每个三角形的平均纳秒数，重复到至少 0.2 秒
+template <class Fill>
+static double run(Image<RGB8> &image, const std::vector<Triangle> &tris, Fill fill) {
+    RGB8::Pixel color = RGB8::pack(255, 255, 255);
+    int rounds = 0;
+    double sec = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    do {
+        for (const Triangle &t : tris) fill(image.view(), t, color);
+        rounds++;
+        sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    } while (sec < 0.2);
+    return sec * 1e9 / ((double)rounds * tris.size());
+}
+
+/// 被覆盖的像素数
+static long long countCovered(Image<RGB8> &image, const std::vector<Triangle> &tris, bool barycentricFill) {
+    long long n = 0;
+    for (const Triangle &t : tris) {
+        image.fill(RGB8::pack(0, 0, 0));
+        if (barycentricFill) fillBarycentric(image.view(), t, RGB8::pack(255, 255, 255));
+        else fillEdge(image.view(), t, RGB8::pack(255, 255, 255));
+        for (int y = 0; y < image.height(); y++)
+            for (int x = 0; x < image.width(); x++) n += image.at(x, y).r != 0;
+        if (&t - tris.data() >= 200) break;  // 抽样，整张图扫一遍太慢
+    }
+    return n;
+}
+
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Image<RGB8> image(opt.size, opt.size);
+    unsigned int seed = 1;
+    auto rnd = [&]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (float)(seed >> 8) / (float)(1 << 24);
+    };
+
+    bool hasAVX2 = setRasterPath(RasterPath::AVX2) == RasterPath::AVX2;
+    std::printf("image         %dx%d, %d triangles per class\n", opt.size, opt.size, opt.triangles);
+    std::printf("%8s %10s %16s %16s %16s %9s %9s %12s\n", "radius", "px/tri", "barycentric ns", "scalar ns",
+                "avx2 ns", "scalar", "avx2", "avx2/scalar");
+    for (float radius : {2.0f, 8.0f, 32.0f, 128.0f}) {
+        std::vector<Triangle> tris(opt.triangles);
+        for (Triangle &t : tris) {
+            float cx = radius + rnd() * ((float)opt.size - 2 * radius);
+            float cy = radius + rnd() * ((float)opt.size - 2 * radius);
+            for (Vec3f &v : t.v) {
+                float a = rnd() * 6.2831853f;
+                v = Vec3f(cx + radius * std::cos(a), cy + radius * std::sin(a), 0);
+            }
+        }
+
+        double bary = run(image, tris, fillBarycentric);
+        setRasterPath(RasterPath::Scalar);
+        double scalar = run(image, tris, fillEdge);
+        double avx2 = 0;
+        if (hasAVX2) {
+            setRasterPath(RasterPath::AVX2);
+            avx2 = run(image, tris, fillEdge);
+        }
+        setRasterPath(RasterPath::Scalar);
+        double pixels = (double)countCovered(image, tris, false) / std::min<size_t>(tris.size(), 201);
+        std::printf("%8.0f %10.1f %16.1f %16.1f %16.1f %8.2fx", radius, pixels, bary, scalar, avx2, bary / scalar);
+        if (hasAVX2) std::printf(" %8.2fx %11.2fx\n", bary / avx2, scalar / avx2);
+        else std::printf(" %9s %12s\n", "-", "-");
+    }
+    return 0;
+}
@@ -0,0 +1,232 @@
+﻿#ifndef RASTERIMPL_H_
+#define RASTERIMPL_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "depthbuffer.h"
+#include "raster.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TR_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TR_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TR_TARGET_AVX2
+#endif
+
+
+/*
+    光栅化内部使用的覆盖测试和层次深度测试，raster.cpp 的纯色填充和 pipeline.h 的着色器光栅化共用
+    不是对外接口
+*/
+
+/*
+    逐行求覆盖区间，标量和 AVX2 实现共用
+    三条边函数在包围盒左端的值按行递推，每行加一次 b * SUBPIXEL_ONE；
+    列方向是线性函数，E + step * k >= 0 的边界用预先算好的倒数估计一下，
+    再用精确的整数边函数前后修正一两步，得到的区间里每个像素都被覆盖，
+    内层循环不用再逐像素测试，包围盒里空着的两个角也不用走
+*/
+class RowSpanner {
+public:
+    explicit RowSpanner(const RasterTriangle &tri) : minX_(tri.minX), width_(tri.maxX - tri.minX) {
+        int64_t px = ((int64_t)tri.minX << SUBPIXEL_BITS) + SUBPIXEL_ONE / 2;
+        int64_t py = ((int64_t)tri.minY << SUBPIXEL_BITS) + SUBPIXEL_ONE / 2;
+        for (int i = 0; i < 3; i++) {
+            const EdgeFunction &e = tri.edge[i];
+            row_[i] = e.a * px + e.b * py + e.c;
+            step_[i] = (int64_t)e.a * SUBPIXEL_ONE;
+            rowStep_[i] = (int64_t)e.b * SUBPIXEL_ONE;
+            inv_[i] = step_[i] ? 1.0 / (double)step_[i] : 0.0;
+        }
+    }
+
+    /// 当前行的覆盖区间 [x0, x1)，为空时 x0 >= x1，然后移到下一行
+    void next(int &x0, int &x1) {
+        if (width_ <= NARROW) {
+            nextNarrow(x0, x1);
+            return;
+        }
+        double lo = 0, hi = width_;
+        for (int i = 0; i < 3; i++) {
+            double q = -(double)row_[i] * inv_[i];  // E + step * k = 0 的解
+            if (step_[i] > 0) lo = std::max(lo, std::ceil(q));
+            else if (step_[i] < 0) hi = std::min(hi, std::floor(q) + 1);
+            else if (row_[i] < 0) hi = -1;  // 和这条水平边平行，整行都在外面
+        }
+        int kLo = (int)std::min(lo, (double)width_), kHi = (int)std::max(hi, 0.0);
+        kHi = std::max(kHi, kLo);
+        // 倒数的舍入误差最多让边界差一个像素，用整数边函数修正
+        while (kLo < kHi && !inside(kLo)) kLo++;
+        while (kLo > 0 && inside(kLo - 1)) kLo--;
+        while (kHi > kLo && !inside(kHi - 1)) kHi--;
+        while (kHi < width_ && inside(kHi)) kHi++;
+        x0 = minX_ + kLo;
+        x1 = minX_ + kHi;
+        for (int i = 0; i < 3; i++) row_[i] += rowStep_[i];
+    }
+
+private:
+    /// 包围盒很窄时估计边界反而更慢，直接逐个像素找
+    static constexpr int NARROW = 8;
+
+    void nextNarrow(int &x0, int &x1) {
+        int k = 0;
+        while (k < width_ && !inside(k)) k++;
+        x0 = minX_ + k;
+        while (k < width_ && inside(k)) k++;
+        x1 = minX_ + k;
+        for (int i = 0; i < 3; i++) row_[i] += rowStep_[i];
+    }
+
+    [[nodiscard]] bool inside(int k) const {
+        return ((row_[0] + step_[0] * k) | (row_[1] + step_[1] * k) | (row_[2] + step_[2] * k)) >= 0;
+    }
+
+    int minX_, width_;
+    int64_t row_[3];      // 当前行包围盒左端像素的边函数值
+    int64_t step_[3];     // 往右一个像素的增量
+    int64_t rowStep_[3];  // 往下一行的增量
+    double inv_[3];       // 1 / step
+};
+
+
+/// 一个块行 (DepthBuffer::BLOCK 行) 里每一行的覆盖区间，和它们在 x 方向的并集
+struct BlockRowSpans {
+    int x0[DepthBuffer::BLOCK], x1[DepthBuffer::BLOCK];  // 第 y - y0 行的 [x0, x1)
+    int minX, maxX;
+};
+
+/// 用 spanner 求 [y0, y1) 各行的覆盖区间，之后只遍历和并集相交的块，包围盒空着的角整块跳过
+/// \return 所有行都没有覆盖时返回 false
+inline bool nextBlockRow(RowSpanner &spanner, const RasterTriangle &tri, int y0, int y1, BlockRowSpans &spans) {
+    spans.minX = tri.maxX;
+    spans.maxX = tri.minX;
+    for (int y = y0; y < y1; y++) {
+        int &x0 = spans.x0[y - y0], &x1 = spans.x1[y - y0];
+        spanner.next(x0, x1);
+        if (x0 < x1) {
+            spans.minX = std::min(spans.minX, x0);
+            spans.maxX = std::max(spans.maxX, x1);
+        }
+    }
+    return spans.minX < spans.maxX;
+}
+
+
+/*
+    层次深度测试
+    三角形在矩形 [x0, x1) * [y0, y1) 内的深度范围，取深度平面在四个角的范围和顶点深度范围的交集，
+    再放宽一点以覆盖逐像素插值的舍入误差
+*/
+struct DepthRange {
+    float lo, hi;
+};
+
+inline DepthRange depthRange(const RasterTriangle &tri, int x0, int x1, int y0, int y1) {
+    float dxLo = (float)x0 + 0.5f - tri.x0, dxHi = (float)x1 - 0.5f - tri.x0;
+    float dyLo = (float)y0 + 0.5f - tri.y0, dyHi = (float)y1 - 0.5f - tri.y0;
+    float ax = tri.zdx * dxLo, bx = tri.zdx * dxHi;
+    float ay = tri.zdy * dyLo, by = tri.zdy * dyHi;
+    float eps = 1e-4f * (1.f + std::max(std::abs(tri.zMin), std::abs(tri.zMax)));
+    float hi = std::min(tri.z[0] + std::max(ax, bx) + std::max(ay, by), tri.zMax) + eps;
+    float lo = std::max(tri.z[0] + std::min(ax, bx) + std::min(ay, by), tri.zMin) - eps;
+    return {lo, hi};
+}
+
+/*
+    块和粗层的剔除对两种 DepthTest 都成立：depthRange() 的上界放宽过，严格大于块内任何像素插值出的深度，
+    上界 <= 已有深度时块内像素都比已有深度远，深度相等的也不会被误剔除
+*/
+
+/// 像素中心的深度，着色和只写深度的光栅化都用它，两遍的结果逐位相同
+inline float pixelDepth(const RasterTriangle &tri, float l0, float l1, float l2) {
+    return tri.z[0] * l0 + tri.z[1] * l1 + tri.z[2] * l2;
+}
+
+inline bool depthPasses(float z, float stored, DepthTest test) {
+    return test == DepthTest::GreaterEqual ? z >= stored : z > stored;
+}
+
+/// 三角形在所覆盖的每个粗层块里都比已有深度远，整个三角形不用画
+inline bool coarseRejected(const DepthBuffer &depth, const RasterTriangle &tri) {
+    const int C = DepthBuffer::COARSE;
+    for (int cy = tri.minY / C; cy <= (tri.maxY - 1) / C; cy++) {
+        for (int cx = tri.minX / C; cx <= (tri.maxX - 1) / C; cx++) {
+            int x0 = std::max(cx * C, tri.minX), x1 = std::min(cx * C + C, tri.maxX);
+            int y0 = std::max(cy * C, tri.minY), y1 = std::min(cy * C + C, tri.maxY);
+            if (depthRange(tri, x0, x1, y0, y1).hi > depth.coarseMin(cx, cy)) return false;
+        }
+    }
+    return true;
+}
+
+
+#ifdef TR_X86
+
+/// 掩码中最低位 1 的下标
+inline int firstLane(int mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long idx;
+    _BitScanForward(&idx, (unsigned long)mask);
+    return (int)idx;
+#else
+    return __builtin_ctz((unsigned int)mask);
+#endif
+}
+
+
+/// 一行中从 x 开始的 8 个像素中心相对插值原点的 x 偏移
+TR_TARGET_AVX2 inline __m256 pixelDx8(const RasterTriangle &tri, int x) {
+    const __m256i laneOffset = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    // 和标量实现按相同顺序求 (x + 0.5) - x0，结果逐位一致，与行内起点无关
+    __m256 px = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(x), laneOffset));
+    return _mm256_sub_ps(_mm256_add_ps(px, _mm256_set1_ps(0.5f)), _mm256_set1_ps(tri.x0));
+}
+
+/// 8 个像素的重心坐标
+/// \param dx pixelDx8() 的结果
+TR_TARGET_AVX2 inline void barycentric8(const RasterTriangle &tri, __m256 dx, float dy,
+                                        __m256 &l1, __m256 &l2, __m256 &l0) {
+    l1 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(tri.a1), dx), _mm256_set1_ps(tri.b1 * dy));
+    l2 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(tri.a2), dx), _mm256_set1_ps(tri.b2 * dy));
+    l0 = _mm256_sub_ps(_mm256_sub_ps(_mm256_set1_ps(1.f), l1), l2);
+}
+
+/// 8 个像素的深度，运算顺序和 pixelDepth() 相同
+TR_TARGET_AVX2 inline __m256 pixelDepth8(const RasterTriangle &tri, __m256 l0, __m256 l1, __m256 l2) {
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(tri.z[0]), l0),
+                                       _mm256_mul_ps(_mm256_set1_ps(tri.z[1]), l1)),
+                         _mm256_mul_ps(_mm256_set1_ps(tri.z[2]), l2));
+}
+
+/// 通过深度测试的通道
+TR_TARGET_AVX2 inline int depthPassMask8(__m256 z, __m256 stored, DepthTest test) {
+    __m256 pass = test == DepthTest::GreaterEqual ? _mm256_cmp_ps(z, stored, _CMP_GE_OQ)
+                                                  : _mm256_cmp_ps(z, stored, _CMP_GT_OQ);
+    return _mm256_movemask_ps(pass);
+}
+
+/// [x0, x1) 在以 base 起始的 8 个通道中对应的位，覆盖区间和 8 像素对齐的块相交的部分
+inline int laneRange(int base, int x0, int x1) {
+    return ((1 << (x1 - base)) - 1) & ~((1 << (x0 - base)) - 1);
+}
+
+/// 掩码的每一位展开成 32 位整型通道，用于 maskload/maskstore
+TR_TARGET_AVX2 inline __m256i laneMask8(int mask) {
+    const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i m = _mm256_and_si256(_mm256_set1_epi32(mask), bits);
+    return _mm256_cmpeq_epi32(m, bits);
+}
+
+#endif // TR_X86
+
+#endif //RASTERIMPL_H_
@@ -0,0 +1,88 @@
+﻿#include "render.h"
+
+#include <iostream>
+
+#include "deferred.h"
+#include "pipeline.h"
+#include "shader.h"
+#include "shadow.h"
+#include "visibility.h"
+
+
+static TextureShader textureShader(Model *model, const Mat4 &modelM, const Mat4 &viewM, const Mat4 &projM,
+                                   const Mat4 &viewportM, Vec3f lightDir) {
+    TextureShader shader(model, lightDir);
+    shader.setMatrices(modelM, viewM, projM, viewportM);
+    return shader;
+}
+
+
+void drawModel(TGAImage &image, Model *model, DepthBuffer &depth, RenderState &state,
+               const Mat4 &modelM, const Mat4 &viewM, const Mat4 &projM, const Mat4 &viewportM,
+               Vec3f lightDir) {
+    TextureShader shader = textureShader(model, modelM, viewM, projM, viewportM, lightDir);
+    if (!drawModel(image, depth, model, shader, state))
+        std::cerr << "unsupported color buffer format: " << image.get_bytespp() << " bytes per pixel\n";
+}
+
+
+void drawModel(Framebuffer &fb, Model *model, RenderState &state,
+               const Mat4 &modelM, const Mat4 &viewM, const Mat4 &projM, const Mat4 &viewportM,
+               Vec3f lightDir) {
+    TextureShader shader = textureShader(model, modelM, viewM, projM, viewportM, lightDir);
+    if (!drawModel(fb, model, shader, state))
+        std::cerr << "unsupported color buffer format: " << fb.color().get_bytespp() << " bytes per pixel\n";
+}
+
+
+void drawModelDeferred(Framebuffer &fb, Model *model, RenderState &state,
+                       const Mat4 &modelM, const Mat4 &viewM, const Mat4 &projM, const Mat4 &viewportM,
+                       Vec3f lightDir) {
+    if (!fb.hasGBuffer()) {
+        std::cerr << "deferred shading needs a framebuffer with a G-buffer\n";
+        return;
+    }
+    GBufferShader shader(model);
+    shader.setMatrices(modelM, viewM, projM, viewportM);
+    drawModelGBuffer(fb, model, shader, state);
+
+    DiffuseLighting lighting(model);
+    lighting.addLight(lightDir);
+    if (!shadeGBuffer(fb, lighting, state.pool))
+        std::cerr << "unsupported color buffer format: " << fb.color().get_bytespp() << " bytes per pixel\n";
+}
+
+
+void drawModelVisibility(Framebuffer &fb, Model *model, RenderState &state,
+                         const Mat4 &modelM, const Mat4 &viewM, const Mat4 &projM, const Mat4 &viewportM,
+                         Vec3f lightDir) {
+    VisibilityShader shader(model);
+    shader.setMatrices(modelM, viewM, projM, viewportM);
+    if (!drawModelVisibility(fb, model, shader, state)) {
+        std::cerr << "visibility buffer needs a framebuffer with setVisibility(true) and at most "
+                  << VISIBILITY_MAX_TRIANGLES << " triangles\n";
+        return;
+    }
+
+    DiffuseLighting lighting(model);
+    lighting.addLight(lightDir);
+    if (!shadeVisibility(fb, &shader, 1, lighting, state.pool))
+        std::cerr << "unsupported color buffer format: " << fb.color().get_bytespp() << " bytes per pixel\n";
+}
+
+
+void drawModelShadowed(Framebuffer &fb, Model *model, const ShadowMap &shadow, RenderState &state,
+                       const Mat4 &modelM, const Mat4 &viewM, const Mat4 &projM, const Mat4 &viewportM) {
+    ShadowShader shader(model, shadow);
+    shader.setMatrices(modelM, viewM, projM, viewportM);
+    if (!drawModel(fb, model, shader, state))
+        std::cerr << "unsupported color buffer format: " << fb.color().get_bytespp() << " bytes per pixel\n";
+}
+
+
+void drawModelDepth(Framebuffer &fb, Model *model, RenderState &state,
+                    const Mat4 &modelM, const Mat4 &viewM, const Mat4 &projM, const Mat4 &viewportM) {
+    DepthShader shader(model);
+    shader.setMatrices(modelM, viewM, projM, viewportM);
+    drawModelDepth(fb.depth(), &fb, model, shader, state);
+}
@@ -0,0 +1,75 @@
+﻿#ifndef RENDER_H_
+#define RENDER_H_
+
+#include <vector>
+
+#include "GMath.h"
+#include "clip.h"
+#include "cull.h"
+#include "depthbuffer.h"
+#include "framebuffer.h"
+#include "model.h"
+#include "parallel.h"
+#include "tgaimage.h"
+#include "tiler.h"
+#include "vertex.h"
+
+
+class ShadowMap;
+
+/// 跨帧复用的渲染中间数据，避免每帧重新分配
+struct RenderState {
+    /// \param threads 光栅化线程数，<= 0 时使用全部硬件线程，1 为单线程
+    explicit RenderState(int threads = 0) : pool(threads) {}
+
+    ScreenVertices screen;  // 顶点阶段输出
+    TileRasterizer tiler;   // 三角形分块
+    ThreadPool pool;        // 各 tile 并行光栅化
+    CullSettings cull;      // 剔除设置
+    ClipSettings clip;      // 裁剪设置
+    CullStats cullStats;    // 最近一次 drawModel 的剔除统计
+    std::vector<unsigned char> shading;  // 逐三角形的着色数据，类型由着色器决定，见 pipeline.h
+    // drawMesh() 先只画一遍深度，着色时只有最前面的像素调用 fragment()；着色器声明了 DISCARDS 时不生效
+    bool depthPrepass = false;
+};
+
+
+/// 变换并光栅化整个模型，窗口程序和无窗口程序共用，用 shader.h 的 TextureShader 着色
+/// 其他着色器见 pipeline.h 的 drawModel()/drawMesh()
+/// \param image 颜色缓冲
+/// \param model 模型
+/// \param depth 深度缓冲，大小和 image 相同
+/// \param state 跨帧复用的中间数据
+/// \param lightDir 平行光方向
+void drawModel(TGAImage &image, Model *model, DepthBuffer &depth, RenderState &state,
+               const Mat4 &modelM, const Mat4 &viewM, const Mat4 &projM, const Mat4 &viewportM,
+               Vec3f lightDir = Vec3f(0, 0, -1));
+
+/// 画到 Framebuffer，只清被画到的 tile；调用前 fb.clear()，读取结果前 fb.resolve()
+void drawModel(Framebuffer &fb, Model *model, RenderState &state,
+               const Mat4 &modelM, const Mat4 &viewM, const Mat4 &projM, const Mat4 &viewportM,
+               Vec3f lightDir = Vec3f(0, 0, -1));
+
+/// 延迟着色：先把模型画进 fb 的 G-buffer，再做一遍全屏着色，漫反射 + 一盏平行光，见 deferred.h
+/// fb 要先 setGBuffer(true)；调用前 fb.clear()，读取结果前 fb.resolve()
+/// \param lightDir 平行光方向，观察空间，默认和 drawModel() 一样从相机射向物体
+void drawModelDeferred(Framebuffer &fb, Model *model, RenderState &state,
+                       const Mat4 &modelM, const Mat4 &viewM, const Mat4 &projM, const Mat4 &viewportM,
+                       Vec3f lightDir = Vec3f(0, 0, -1));
+
+/// 可见性缓冲：光栅化只写三角形编号和深度，再逐像素从模型数据重建属性着色，光照同 drawModelDeferred()，
+/// 见 visibility.h；fb 要先 setVisibility(true)，resolve() 之后可以用 pick() 读编号
+void drawModelVisibility(Framebuffer &fb, Model *model, RenderState &state,
+                         const Mat4 &modelM, const Mat4 &viewM, const Mat4 &projM, const Mat4 &viewportM,
+                         Vec3f lightDir = Vec3f(0, 0, -1));
+
+/// 带阴影的前向渲染，用 shadow.h 的 ShadowShader，平行光方向取 shadow.direction()
+/// \param shadow 本帧已经 clear() 并对每个投影物 render() 过
+void drawModelShadowed(Framebuffer &fb, Model *model, const ShadowMap &shadow, RenderState &state,
+                       const Mat4 &modelM, const Mat4 &viewM, const Mat4 &projM, const Mat4 &viewportM);
+
+/// 只画深度，不碰颜色缓冲，见 pipeline.h 的 drawMeshDepth()；调用前 fb.clear()
+void drawModelDepth(Framebuffer &fb, Model *model, RenderState &state,
+                    const Mat4 &modelM, const Mat4 &viewM, const Mat4 &projM, const Mat4 &viewportM);
+
+#endif //RENDER_H_
@@ -0,0 +1,159 @@
+﻿#ifndef SHADER_H_
+#define SHADER_H_
+
+#include <algorithm>
+#include <type_traits>
+
+#include "GMath.h"
+#include "clip.h"
+#include "model.h"
+#include "tgaimage.h"
+#include "varyings.h"
+#include "vertex.h"
+
+
+/*
+    可编程着色器
+    着色器是普通的类，作为模板参数传给 pipeline.h 的 drawMesh()/drawModel()，
+    顶点和片元阶段在光栅化循环里直接内联，每个像素没有虚函数调用
+    着色器以 CRTP 方式继承 IShader<自己, varying 个数, 逐三角形常量>，并提供：
+
+        Vec4f vertex(int vert, float *varyings) const
+            顶点阶段，网格的每个顶点调用一次（不是每个三角形的每个角），
+            返回乘过 viewport 的裁剪空间坐标（相机前方 w < 0），并写出 VARYINGS 个 varying
+        bool fragment(const Flat &flat, Varyings in, TGAColor &color) const
+            片元阶段，通过深度测试的像素调用一次，in 是透视矫正插值后的 varyings，见 varyings.h；
+            返回 false 丢弃这个像素，深度也不写。输出类型由光栅化目标决定，
+            画到颜色缓冲时是 TGAColor，画到 G-buffer 时是 GBufferTexel，见 deferred.h
+        static constexpr int DERIVATIVES = n
+            前 n 个 varying 要屏幕空间偏导时声明（纹理坐标选 mip 层），fragment() 里用 in.ddx(k)/in.ddy(k) 读，
+            每个 2x2 像素块算一份，见 varyings.h
+        static constexpr bool DISCARDS = true
+            fragment() 会返回 false 时要声明，否则深度预渲染 (RenderState::depthPrepass) 会留下被丢弃像素的深度，
+            后面的表面通不过深度测试
+
+    可选：
+        Flat triangle(int face, const Vec3f *pts) const
+            每个三角形 setup 时调用一次，算面光照之类整个三角形不变的量，
+            face 是三角形在索引数组中的序号，被近平面裁成几块时每块都是原来的序号，
+            pts 是三个顶点的屏幕坐标；透视矫正后偏导随位置变化，mip 层不在这里算，见 DERIVATIVES
+
+    管线只保存和插值声明过的 VARYINGS 个 float；各阶段会在多个线程上同时调用，所以都是 const
+*/
+
+/// 没有逐三角形常量的着色器用
+struct NoFlat {};
+
+
+template <class Derived, int NVaryings, class FlatData = NoFlat>
+class IShader {
+public:
+    static_assert(NVaryings >= 0 && NVaryings <= MAX_VARYINGS, "a vertex carries at most MAX_VARYINGS floats");
+    static_assert(std::is_trivially_copyable<FlatData>::value && std::is_trivially_destructible<FlatData>::value,
+                  "per-triangle data is kept in a raw byte buffer");
+
+    /// 每个顶点输出的 float varying 个数，管线只插值这么多
+    static constexpr int VARYINGS = NVaryings;
+
+    /// 逐三角形常量，triangle() 的返回值
+    using Flat = FlatData;
+
+    /// fragment() 要偏导的 varying 个数，派生类可以覆盖
+    static constexpr int DERIVATIVES = 0;
+
+    /// fragment() 是否会返回 false，派生类可以覆盖
+    static constexpr bool DISCARDS = false;
+
+    void setModel(const Mat4 &model) { modelM = model; update(); }
+    void setLookAt(const Mat4 &lookat) { lookatM = lookat; update(); }
+    void setProj(const Mat4 &proj) { projM = proj; update(); }
+    void setViewPort(const Mat4 &viewport) { viewportM = viewport; update(); }
+
+    void setMatrices(const Mat4 &model, const Mat4 &lookat, const Mat4 &proj, const Mat4 &viewport) {
+        modelM = model;
+        lookatM = lookat;
+        projM = proj;
+        viewportM = viewport;
+        update();
+    }
+
+    /// viewport * projection * view * model，设置矩阵时更新
+    [[nodiscard]] const Mat4 &mvp() const { return mvpM; }
+
+    /// view * model，模型空间到观察空间
+    [[nodiscard]] const Mat4 &modelView() const { return modelViewM; }
+
+    /// 默认没有逐三角形的计算
+    Flat triangle(int, const Vec3f *) const { return Flat(); }
+
+protected:
+    Mat4 modelM = Mat4::identity();
+    Mat4 lookatM = Mat4::identity();
+    Mat4 projM = Mat4::identity();
+    Mat4 viewportM = Mat4::identity();
+    Mat4 mvpM = Mat4::identity();
+    Mat4 modelViewM = Mat4::identity();
+
+private:
+    void update() {
+        mvpM = concatMVP(modelM, lookatM, projM, viewportM);
+        modelViewM = lookatM * modelM;
+    }
+};
+
+
+/// TextureShader 逐三角形的常量
+struct TextureFlat {
+    float intensity;  // 平行光亮度
+};
+
+/*
+    drawModel() 默认的着色器：纹理坐标是唯一的 varying，透视矫正插值，
+    亮度按屏幕空间的面法线和平行光方向逐三角形算一次 (flat shading)，mip 层由纹理坐标的偏导每个 2x2 像素块算一次
+*/
+class TextureShader : public IShader<TextureShader, 2, TextureFlat> {
+public:
+    static constexpr int DERIVATIVES = 2;
+
+    /// \param lightDir 平行光方向，屏幕空间
+    TextureShader(Model *model, Vec3f lightDir) : model_(model), lightDir_(lightDir) {}
+
+    Vec4f vertex(int vert, float *varyings) const {
+        Vec2f uv = model_->uvs()[vert];
+        varyings[0] = uv.x;
+        varyings[1] = uv.y;
+        return mvp() * Vec4f(model_->verts()[vert], 1.f);
+    }
+
+    TextureFlat triangle(int, const Vec3f *pts) const {
+        Vec3f n = cross(pts[2] - pts[0], pts[1] - pts[0]);
+        n.normalize();
+        return {std::max(n * lightDir_, 0.1f)};
+    }
+
+    bool fragment(const TextureFlat &flat, Varyings in, TGAColor &color) const {
+        float lod = model_->diffuseLod(Vec2f(in.ddx(0), in.ddx(1)), Vec2f(in.ddy(0), in.ddy(1)));
+        TGAColor diffuse = model_->diffuse(in[0], in[1], lod);
+        color = TGAColor((unsigned char)(flat.intensity * diffuse.r), (unsigned char)(flat.intensity * diffuse.g),
+                         (unsigned char)(flat.intensity * diffuse.b), 255);
+        return true;
+    }
+
+private:
+    Model *model_;
+    Vec3f lightDir_;
+};
+
+
+/// 只有位置的着色器，给 drawMeshDepth() 画阴影贴图之类只要深度的场合用
+class DepthShader : public IShader<DepthShader, 0> {
+public:
+    explicit DepthShader(const Model *model) : model_(model) {}
+
+    Vec4f vertex(int vert, float *) const { return mvp() * Vec4f(model_->verts()[vert], 1.f); }
+
+private:
+    const Model *model_;
+};
+
+#endif //SHADER_H_
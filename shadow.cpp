@@ -0,0 +1,52 @@
+﻿#include "shadow.h"
+
+#include <cmath>
+
+#include "mvp.h"
+#include "pipeline.h"
+
+
+ShadowMap::ShadowMap(int size) : depth_(size, size) { setDirectional(dir_, Vec3f(0, 0, 0), 1.f); }
+
+
+void ShadowMap::setDirectional(Vec3f dir, Vec3f center, float radius) {
+    dir_ = dir.normalize();
+    // 光源放在区域外面，近平面和远平面正好夹住整个球
+    Vec3f eye = center - dir_ * (2.f * radius);
+    Vec3f up = std::abs(dir_.y) > 0.99f ? Vec3f(1, 0, 0) : Vec3f(0, 1, 0);
+    Mat4 viewM = lookAt(eye, center, up);
+    Mat4 projM = orthographic(-radius, radius, -radius, radius, radius, 3.f * radius);
+    lightM_ = viewport(0, 0, size(), size()) * projM * viewM;
+}
+
+
+void ShadowMap::clear() { depth_.clear(); }
+
+
+void ShadowMap::render(Model *model, const Mat4 &modelM, RenderState &state) {
+    DepthShader shader(model);
+    shader.setMatrices(modelM, Mat4::identity(), Mat4::identity(), lightM_);
+    // 阴影贴图里背面也要留下，否则只有朝向光源的面挡光，薄的物体会漏光
+    CullSettings cull = state.cull;
+    state.cull.backFace = false;
+    drawModelDepth(depth_, nullptr, model, shader, state);
+    state.cull = cull;
+}
+
+
+float ShadowMap::lit(float x, float y, float z) const {
+    const int n = size();
+    int cx = (int)std::floor(x), cy = (int)std::floor(y);
+    if (cx < 0 || cy < 0 || cx >= n || cy >= n) return 1.f;
+    const float *z0 = depth_.data();
+    float reference = z + bias;
+    int litTaps = 0, taps = 0;
+    for (int ty = std::max(cy - pcfRadius, 0); ty <= std::min(cy + pcfRadius, n - 1); ty++) {
+        const float *row = z0 + (size_t)ty * n;
+        for (int tx = std::max(cx - pcfRadius, 0); tx <= std::min(cx + pcfRadius, n - 1); tx++) {
+            litTaps += reference >= row[tx];  // 越大越近，阴影贴图里的表面更近就是被挡住了
+            taps++;
+        }
+    }
+    return (float)litTaps / (float)taps;
+}
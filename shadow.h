@@ -0,0 +1,118 @@
+﻿#ifndef SHADOW_H_
+#define SHADOW_H_
+
+#include <algorithm>
+
+#include "GMath.h"
+#include "depthbuffer.h"
+#include "model.h"
+#include "render.h"
+#include "shader.h"
+#include "tgaimage.h"
+#include "varyings.h"
+
+
+/*
+    阴影贴图 (shadow mapping)
+    1. render()：从光源方向只画深度 (pipeline.h 的 drawMeshDepth())，每个纹素留下离光源最近的表面
+    2. 正常渲染时把片元变换到光源的屏幕空间，比阴影贴图里记下的深度远，说明中间有东西挡光，在阴影里
+    平行光用正交投影，覆盖以 center 为中心、半径 radius 的球，模型坐标到光源屏幕坐标是仿射变换，
+    着色器可以直接插值光源屏幕坐标，不用再做透视除法
+    深度偏移 bias 避免表面自己挡住自己 (shadow acne)；PCF (percentage-closer filtering) 在周围
+    (2 * pcfRadius + 1)^2 个纹素上各比较一次再取平均，阴影边缘从锯齿变成过渡
+*/
+class ShadowMap {
+public:
+    /// \param size 阴影贴图边长
+    explicit ShadowMap(int size = 1024);
+
+    /// \param dir 光线前进的方向，世界空间
+    /// \param center 要投下阴影的区域的中心，世界空间
+    /// \param radius 区域半径，区域外的物体不投阴影，也不会被照成阴影
+    void setDirectional(Vec3f dir, Vec3f center, float radius);
+
+    /// 清空阴影贴图，之后对每个投影物调用一次 render()
+    void clear();
+
+    /// 把模型画进阴影贴图，只写深度
+    /// \param modelM 模型矩阵，和正常渲染时相同
+    void render(Model *model, const Mat4 &modelM, RenderState &state);
+
+    /// 世界空间到阴影贴图屏幕空间，viewport * orthographic * lightView
+    [[nodiscard]] const Mat4 &lightMatrix() const { return lightM_; }
+
+    /// 光线前进的方向，单位向量
+    [[nodiscard]] Vec3f direction() const { return dir_; }
+
+    [[nodiscard]] int size() const { return depth_.width(); }
+
+    const DepthBuffer &depth() const { return depth_; }
+
+    /// 光源屏幕空间的点被照亮的比例，0 全在阴影里，1 完全照亮；贴图外的点算照亮
+    [[nodiscard]] float lit(float x, float y, float z) const;
+
+    float bias = 1.0f;  // 深度偏移，单位和 viewport 的深度 [0, VIEWPORT_DEPTH] 相同
+    int pcfRadius = 1;  // 0 只比较一个纹素，硬阴影
+
+private:
+    DepthBuffer depth_;
+    Mat4 lightM_ = Mat4::identity();
+    Vec3f dir_{0, 0, -1};
+};
+
+
+/// ShadowShader 逐三角形的常量
+struct ShadowFlat {
+    float diffuse;  // 照亮时的漫反射亮度
+};
+
+/*
+    带阴影的纹理着色器，光照换成世界空间：亮度 = ambient + max(n · -dir, 0) * lit，
+    n 是模型矩阵变换后的面法线，逐三角形算一次；lit 是阴影贴图的 PCF 结果，逐像素查；mip 层每个 2x2 像素块算一次
+    varyings 是纹理坐标和光源屏幕坐标，光源是平行光时后者随模型坐标线性变化，插值结果精确
+*/
+class ShadowShader : public IShader<ShadowShader, 5, ShadowFlat> {
+public:
+    static constexpr int DERIVATIVES = 2;
+
+    ShadowShader(Model *model, const ShadowMap &shadow, float ambient = 0.1f)
+        : model_(model), shadow_(shadow), ambient_(ambient) {}
+
+    Vec4f vertex(int vert, float *varyings) const {
+        Vec2f uv = model_->uvs()[vert];
+        Vec4f world = modelM * Vec4f(model_->verts()[vert], 1.f);
+        Vec4f light = shadow_.lightMatrix() * world;
+        varyings[0] = uv.x;
+        varyings[1] = uv.y;
+        varyings[2] = light.x / light.w;
+        varyings[3] = light.y / light.w;
+        varyings[4] = light.z / light.w;
+        return mvp() * Vec4f(model_->verts()[vert], 1.f);
+    }
+
+    ShadowFlat triangle(int face, const Vec3f *) const {
+        const int *idx = model_->face(face);
+        const Vec3f *v = model_->verts();
+        Vec4f n = modelM * Vec4f(cross(v[idx[1]] - v[idx[0]], v[idx[2]] - v[idx[0]]), 0.f);
+        Vec3f normal(n.x, n.y, n.z);
+        float diffuse = normal.norm() > 0.f ? std::max(normal.normalize() * shadow_.direction() * -1.f, 0.f) : 0.f;
+        return {diffuse};
+    }
+
+    bool fragment(const ShadowFlat &flat, Varyings in, TGAColor &color) const {
+        float intensity = ambient_;
+        if (flat.diffuse > 0.f) intensity += flat.diffuse * shadow_.lit(in[2], in[3], in[4]);
+        float lod = model_->diffuseLod(Vec2f(in.ddx(0), in.ddx(1)), Vec2f(in.ddy(0), in.ddy(1)));
+        TGAColor diffuse = model_->diffuse(in[0], in[1], lod);
+        auto scale = [&](unsigned char c) { return (unsigned char)std::min(c * intensity, 255.f); };
+        color = TGAColor(scale(diffuse.r), scale(diffuse.g), scale(diffuse.b), 255);
+        return true;
+    }
+
+private:
+    Model *model_;
+    const ShadowMap &shadow_;
+    float ambient_;
+};
+
+#endif //SHADOW_H_
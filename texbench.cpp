@@ -0,0 +1,130 @@
+﻿#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "texture.h"
+#include "tgaimage.h"
+
+/*
+    纹理取样吞吐量测试，比较逐行排列和 4x4 分块排列
+    沿若干旋转角度的直线在第 0 层上走，每步前进约一个纹素，模拟放大/等比例显示时相邻像素的取样
+    用法: CPU_Render_TexBench [-s size] [-n rays] [diffuse.tga]
+*/
+
+struct Options {
+    int size = 2048;   // 没有给贴图时生成的棋盘格边长
+    int rays = 8192;   // 每个角度的直线条数
+    int steps = 256;   // 每条直线的步数
+    std::string texture;
+};
+
+static void usage(const char *exe) {
+    std::fprintf(stderr,
+                 "usage: %s [-s size] [-n rays] [diffuse.tga]\n"
+                 "  -s  size of the generated test texture when no file is given (default 2048)\n"
+                 "  -n  rays per angle, each %d fetches long (default 8192)\n",
+                 exe, Options().steps);
+}
+
+static bool parseArgs(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (!std::strcmp(arg, "-s") && hasValue) opt.size = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "-n") && hasValue) opt.rays = std::atoi(argv[++i]);
+        else if (arg[0] != '-' && opt.texture.empty()) opt.texture = arg;
+        else return false;
+    }
+    return opt.size > 0 && opt.rays > 0;
+}
+
+/// 带噪声的棋盘格，避免整块纹素相同
+static void makeTestImage(TGAImage &image, int size) {
+    image = TGAImage(size, size, TGAImage::RGB);
+    unsigned int seed = 12345;
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            seed = seed * 1664525u + 1013904223u;
+            unsigned char base = ((x / 32 + y / 32) & 1) ? 200 : 50;
+            unsigned char n = (unsigned char)(seed >> 27);
+            image.set(x, y, TGAColor(base + n, base, base - n, 255));
+        }
+    }
+}
+
+struct Ray {
+    float u, v;
+};
+
+/// 返回每秒取样次数，checksum 防止取样被优化掉
+static double walk(const Texture &tex, TextureFilter filter, float angle, const std::vector<Ray> &rays,
+                   int steps, unsigned int &checksum) {
+    float du = std::cos(angle) / (float)tex.width(), dv = std::sin(angle) / (float)tex.height();
+    auto t0 = std::chrono::steady_clock::now();
+    unsigned int sum = 0;
+    for (const Ray &r : rays) {
+        float u = r.u, v = r.v;
+        for (int i = 0; i < steps; i++) {
+            sum += tex.sample(u, v, 0.0f, filter).val;
+            u += du;
+            v += dv;
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    checksum += sum;
+    double sec = std::chrono::duration<double>(t1 - t0).count();
+    return (double)rays.size() * steps / sec;
+}
+
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    TGAImage image;
+    if (opt.texture.empty()) {
+        makeTestImage(image, opt.size);
+    } else if (!image.read_tga_file(opt.texture.c_str())) {
+        std::fprintf(stderr, "can't read %s\n", opt.texture.c_str());
+        return 1;
+    }
+    Texture linear(image, false, TextureLayout::Linear);
+    Texture tiled(image, false, TextureLayout::Tiled);
+    std::printf("texture       %dx%d, %.1f MiB\n", linear.width(), linear.height(),
+                (double)linear.width() * linear.height() * 4 / (1 << 20));
+
+    // 起点随机分布，直线整体落在 [0, 1] 内
+    std::vector<Ray> rays(opt.rays);
+    unsigned int seed = 1;
+    float margin = (float)opt.steps / (float)std::min(linear.width(), linear.height());
+    auto rnd = [&]() {
+        seed = seed * 1664525u + 1013904223u;
+        return (float)(seed >> 8) / (float)(1 << 24);
+    };
+    for (Ray &r : rays) {
+        r.u = margin + rnd() * std::max(0.0f, 1.0f - 2 * margin);
+        r.v = margin + rnd() * std::max(0.0f, 1.0f - 2 * margin);
+    }
+
+    unsigned int checksum = 0;
+    const float pi = 3.14159265f;
+    std::printf("%-10s %6s %14s %14s %8s\n", "filter", "angle", "linear Mf/s", "tiled Mf/s", "speedup");
+    for (TextureFilter filter : {TextureFilter::Nearest, TextureFilter::Bilinear}) {
+        const char *name = filter == TextureFilter::Nearest ? "nearest" : "bilinear";
+        for (int deg : {0, 30, 45, 60, 90, 135}) {
+            float angle = (float)deg * pi / 180.0f;
+            double a = walk(linear, filter, angle, rays, opt.steps, checksum);
+            double b = walk(tiled, filter, angle, rays, opt.steps, checksum);
+            std::printf("%-10s %6d %14.1f %14.1f %7.2fx\n", name, deg, a / 1e6, b / 1e6, b / a);
+        }
+    }
+    std::printf("checksum      %08x\n", checksum);
+    return 0;
+}
@@ -0,0 +1,170 @@
+﻿#include "texture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "parallel.h"
+
+
+void Texture::load(TGAImage &image, bool mipmaps, TextureLayout layout) {
+    levels_.clear();
+    layout_ = layout;
+    int w = image.get_width(), h = image.get_height(), bpp = image.get_bytespp();
+    if (w <= 0 || h <= 0 || !image.buffer()) return;
+
+    Level base;
+    base.w = w;
+    base.h = h;
+    base.texels.resize((size_t)w * h);
+    const unsigned char *src = image.buffer();
+    for (size_t i = 0; i < base.texels.size(); i++, src += bpp) {
+        unsigned char p[4] = {0, 0, 0, 255};
+        if (bpp == TGAImage::GRAYSCALE) {
+            p[0] = p[1] = p[2] = src[0];
+        } else {
+            memcpy(p, src, std::min(bpp, 4));
+        }
+        memcpy(&base.texels[i], p, 4);
+    }
+    levels_.push_back(std::move(base));
+    if (mipmaps) buildMips();
+
+    // mip 链按逐行排列生成，最后再统一转换
+    if (layout_ == TextureLayout::Tiled) {
+        defaultThreadPool().run((int)levels_.size(), [&](int i) { tile(levels_[i]); });
+    }
+}
+
+
+void Texture::tile(Level &level) {
+    level.tilesX = (level.w + TILE - 1) / TILE;
+    int tilesY = (level.h + TILE - 1) / TILE;
+    std::vector<uint32_t> tiled((size_t)level.tilesX * tilesY * TILE * TILE);
+    uint32_t *out = tiled.data();
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < level.tilesX; tx++) {
+            // 补齐的部分重复边缘纹素，不会被采样到
+            for (int y = 0; y < TILE; y++) {
+                const uint32_t *row = level.texels.data() + (size_t)std::min(ty * TILE + y, level.h - 1) * level.w;
+                for (int x = 0; x < TILE; x++) *out++ = row[std::min(tx * TILE + x, level.w - 1)];
+            }
+        }
+    }
+    level.texels.swap(tiled);
+}
+
+
+/// 4 个纹素逐通道求平均，四舍五入
+static inline uint32_t average4(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+    uint32_t res = 0;
+    for (int s = 0; s < 32; s += 8) {
+        uint32_t sum = ((a >> s) & 0xff) + ((b >> s) & 0xff) + ((c >> s) & 0xff) + ((d >> s) & 0xff);
+        res |= ((sum + 2) >> 2) << s;
+    }
+    return res;
+}
+
+void Texture::buildMips() {
+    ThreadPool &pool = defaultThreadPool();
+    while (levels_.back().w > 1 || levels_.back().h > 1) {
+        const Level &src = levels_.back();
+        Level dst;
+        dst.w = std::max(src.w / 2, 1);
+        dst.h = std::max(src.h / 2, 1);
+        dst.texels.resize((size_t)dst.w * dst.h);
+        // 一行里只有几个纹素的小层不值得分发
+        int grain = std::max(1, 4096 / dst.w);
+        pool.parallelFor(0, dst.h, [&](int y) {
+            const uint32_t *r0 = src.texels.data() + (size_t)std::min(2 * y, src.h - 1) * src.w;
+            const uint32_t *r1 = src.texels.data() + (size_t)std::min(2 * y + 1, src.h - 1) * src.w;
+            uint32_t *out = dst.texels.data() + (size_t)y * dst.w;
+            for (int x = 0; x < dst.w; x++) {
+                int x0 = std::min(2 * x, src.w - 1), x1 = std::min(2 * x + 1, src.w - 1);
+                out[x] = average4(r0[x0], r0[x1], r1[x0], r1[x1]);
+            }
+        }, grain);
+        levels_.push_back(std::move(dst));
+    }
+}
+
+
+float Texture::lod(Vec2f uvdx, Vec2f uvdy) const {
+    if (levels_.empty()) return 0.0f;
+    float w = (float)levels_[0].w, h = (float)levels_[0].h;
+    float dx2 = uvdx.x * uvdx.x * w * w + uvdx.y * uvdx.y * h * h;
+    float dy2 = uvdy.x * uvdy.x * w * w + uvdy.y * uvdy.y * h * h;
+    // log2(sqrt(x)) = 0.5 * log2(x)
+    return 0.5f * std::log2(std::max(std::max(dx2, dy2), 1e-12f));
+}
+
+
+TGAColor Texture::texel(int level, int x, int y) const {
+    const Level &l = levels_[level];
+    x = std::clamp(x, 0, l.w - 1);
+    y = std::clamp(y, 0, l.h - 1);
+    TGAColor c;
+    c.val = l.texels[l.index(x, y, layout_)];
+    c.bytespp = 4;
+    return c;
+}
+
+
+TGAColor Texture::nearest(int level, float u, float v) const {
+    const Level &l = levels_[level];
+    return texel(level, (int)std::floor((float)l.w * u), (int)std::floor((float)l.h * v));
+}
+
+
+void Texture::bilinear(int level, float u, float v, float out[4]) const {
+    const Level &l = levels_[level];
+    // 纹素中心在 (i + 0.5) / w
+    float fx = u * (float)l.w - 0.5f, fy = v * (float)l.h - 0.5f;
+    float x0f = std::floor(fx), y0f = std::floor(fy);
+    float tx = fx - x0f, ty = fy - y0f;
+    int x0 = (int)x0f, y0 = (int)y0f;
+    int xa = std::clamp(x0, 0, l.w - 1), xb = std::clamp(x0 + 1, 0, l.w - 1);
+    int ya = std::clamp(y0, 0, l.h - 1), yb = std::clamp(y0 + 1, 0, l.h - 1);
+    const uint32_t *t = l.texels.data();
+    uint32_t c00 = t[l.index(xa, ya, layout_)], c10 = t[l.index(xb, ya, layout_)];
+    uint32_t c01 = t[l.index(xa, yb, layout_)], c11 = t[l.index(xb, yb, layout_)];
+    for (int i = 0; i < 4; i++) {
+        int s = i * 8;
+        float top = (float)((c00 >> s) & 0xff) + ((float)((c10 >> s) & 0xff) - (float)((c00 >> s) & 0xff)) * tx;
+        float bot = (float)((c01 >> s) & 0xff) + ((float)((c11 >> s) & 0xff) - (float)((c01 >> s) & 0xff)) * tx;
+        out[i] = top + (bot - top) * ty;
+    }
+}
+
+
+static inline TGAColor packColor(const float c[4]) {
+    return TGAColor((unsigned char)(c[2] + 0.5f), (unsigned char)(c[1] + 0.5f), (unsigned char)(c[0] + 0.5f),
+                    (unsigned char)(c[3] + 0.5f));
+}
+
+TGAColor Texture::sample(float u, float v, float lod, TextureFilter filter) const {
+    if (levels_.empty()) return TGAColor();
+    int last = (int)levels_.size() - 1;
+    lod = std::clamp(lod, 0.0f, (float)last);
+
+    switch (filter) {
+        case TextureFilter::Nearest:
+            return nearest(std::min((int)(lod + 0.5f), last), u, v);
+        case TextureFilter::Bilinear: {
+            float c[4];
+            bilinear(std::min((int)(lod + 0.5f), last), u, v, c);
+            return packColor(c);
+        }
+        default: {
+            int l0 = (int)lod, l1 = std::min(l0 + 1, last);
+            float t = lod - (float)l0;
+            float a[4], b[4];
+            bilinear(l0, u, v, a);
+            if (t > 0.0f && l1 != l0) {
+                bilinear(l1, u, v, b);
+                for (int i = 0; i < 4; i++) a[i] += (b[i] - a[i]) * t;
+            }
+            return packColor(a);
+        }
+    }
+}
@@ -0,0 +1,97 @@
+﻿#ifndef TEXTURE_H_
+#define TEXTURE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "GMath.h"
+#include "tgaimage.h"
+
+
+/// 纹素在内存中的排列方式
+enum class TextureLayout {
+    Linear,  // 逐行排列
+    Tiled,   // 4x4 纹素一块（正好 64 字节一条缓存行），块之间逐行排列
+};
+
+enum class TextureFilter {
+    Nearest,    // 最近的 mip 层，最近的纹素
+    Bilinear,   // 最近的 mip 层，双线性
+    Trilinear,  // 相邻两层各做双线性再按 lod 小数部分混合
+};
+
+/*
+    带完整 mip 链的纹理
+    纹素统一存成 4 字节 BGRA（和 TGAColor 的内存布局相同），每层是上一层 2x2 的盒式滤波，
+    宽高为奇数时边上的纹素重复使用，一直缩到 1x1
+    缩小时按屏幕上纹理坐标的变化率选层，相邻像素取的纹素也相邻，访存保持局部
+    坐标超出 [0, 1] 时取边缘纹素
+    默认按 4x4 块存放：沿 UV 斜向或竖直方向走时，逐行排列几乎每次取纹素都要换一条缓存行，
+    分块后一条缓存行覆盖一个正方形区域，双线性的 2x2 纹素也大多落在同一条缓存行里
+*/
+class Texture {
+public:
+    Texture() = default;
+
+    /// \param image 第 0 层，灰度/RGB/RGBA 都可以
+    /// \param mipmaps 是否生成 mip 链，否则只有第 0 层
+    /// \param layout 纹素排列方式
+    explicit Texture(TGAImage &image, bool mipmaps = true, TextureLayout layout = TextureLayout::Tiled) {
+        load(image, mipmaps, layout);
+    }
+
+    void load(TGAImage &image, bool mipmaps = true, TextureLayout layout = TextureLayout::Tiled);
+
+    [[nodiscard]] TextureLayout layout() const { return layout_; }
+
+    [[nodiscard]] bool empty() const { return levels_.empty(); }
+
+    [[nodiscard]] int nLevels() const { return (int)levels_.size(); }
+
+    [[nodiscard]] int width(int level = 0) const { return levels_[level].w; }
+
+    [[nodiscard]] int height(int level = 0) const { return levels_[level].h; }
+
+    /// 由屏幕空间的纹理坐标偏导计算 lod，即 log2(一个像素覆盖的纹素数)
+    /// \param uvdx 纹理坐标对屏幕 x 的偏导
+    /// \param uvdy 纹理坐标对屏幕 y 的偏导
+    [[nodiscard]] float lod(Vec2f uvdx, Vec2f uvdy) const;
+
+    /// \param lod <= 0 时为放大，只用第 0 层
+    [[nodiscard]] TGAColor sample(float u, float v, float lod, TextureFilter filter) const;
+
+    /// 第 level 层的纹素，越界时夹到边缘
+    [[nodiscard]] TGAColor texel(int level, int x, int y) const;
+
+private:
+    static constexpr int TILE_BITS = 2;
+    static constexpr int TILE = 1 << TILE_BITS;
+
+    struct Level {
+        int w = 0, h = 0;
+        int tilesX = 0;  // 分块排列时每行的块数
+        std::vector<uint32_t> texels;
+
+        /// (x, y) 处纹素在 texels 中的下标，x/y 必须在范围内
+        [[nodiscard]] size_t index(int x, int y, TextureLayout layout) const {
+            if (layout == TextureLayout::Linear) return (size_t)y * w + x;
+            size_t tile = (size_t)(y >> TILE_BITS) * tilesX + (x >> TILE_BITS);
+            return (tile << (2 * TILE_BITS)) + ((y & (TILE - 1)) << TILE_BITS) + (x & (TILE - 1));
+        }
+    };
+
+    void buildMips();
+
+    /// 把逐行排列的一层改成分块排列，宽高补齐到 TILE 的整数倍
+    static void tile(Level &level);
+
+    [[nodiscard]] TGAColor nearest(int level, float u, float v) const;
+
+    /// 双线性，结果为未取整的 BGRA 四个通道
+    void bilinear(int level, float u, float v, float out[4]) const;
+
+    std::vector<Level> levels_;
+    TextureLayout layout_ = TextureLayout::Tiled;
+};
+
+#endif //TEXTURE_H_
@@ -1,11 +1,16 @@
 ﻿#include "tgaimage.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <cstring>
 #include <ctime>
 
 #include <fstream>
 #include <iostream>
+#include <vector>
+
+#include "mmap.h"
 
 TGAImage::TGAImage() : data(NULL), width(0), height(0), bytespp(0) {}
 
@@ -25,13 +30,26 @@ TGAImage::TGAImage(const TGAImage &img) {
     memcpy(data, img.data, nbytes);
 }
 
-TGAImage::~TGAImage() {
-    if (data) delete[] data;
+TGAImage::TGAImage(TGAImage &&img) noexcept
+    : data(img.data), width(img.width), height(img.height), bytespp(img.bytespp), mapping(std::move(img.mapping)) {
+    img.data = NULL;
+    img.width = img.height = img.bytespp = 0;
+}
+
+TGAImage::~TGAImage() { release(); }
+
+void TGAImage::release() {
+    if (mapping) {
+        mapping.reset();
+    } else if (data) {
+        delete[] data;
+    }
+    data = NULL;
 }
 
 TGAImage &TGAImage::operator=(const TGAImage &img) {
     if (this != &img) {
-        if (data) delete[] data;
+        release();
         width = img.width;
         height = img.height;
         bytespp = img.bytespp;
@@ -42,124 +60,177 @@ TGAImage &TGAImage::operator=(const TGAImage &img) {
     return *this;
 }
 
-bool TGAImage::read_tga_file(const char *filename) {
-    if (data) delete[] data;
-    data = NULL;
-    std::ifstream in;
-    in.open(filename, std::ios::binary);
-    if (!in.is_open()) {
+TGAImage &TGAImage::operator=(TGAImage &&img) noexcept {
+    if (this != &img) {
+        release();
+        data = img.data;
+        width = img.width;
+        height = img.height;
+        bytespp = img.bytespp;
+        mapping = std::move(img.mapping);
+        img.data = NULL;
+        img.width = img.height = img.bytespp = 0;
+    }
+    return *this;
+}
+
+/*
+    整个文件内存映射后解码，不再逐字节 in.get()
+    行序按 bottomUp 和文件头里的原点一次确定，每行直接写到最终位置，不用再翻转一遍
+    未压缩且行序刚好一致时直接使用映射的内存，不拷贝
+*/
+bool TGAImage::read_tga_file(const char *filename, bool bottomUp) {
+    release();
+    auto file = std::make_unique<MappedFile>();
+    if (!file->open(filename, true)) {
         std::cerr << "can't open file " << filename << "\n";
-        in.close();
         return false;
     }
+    const unsigned char *begin = (const unsigned char *)file->data();
+    const unsigned char *end = begin + file->size();
     TGA_Header header;
-    in.read((char *)&header, sizeof(header));
-    if (!in.good()) {
-        in.close();
+    if (file->size() < sizeof(header)) {
         std::cerr << "an error occured while reading the header\n";
         return false;
     }
-    width = header.width;
-    height = header.height;
-    bytespp = header.bitsperpixel >> 3;
+    memcpy(&header, begin, sizeof(header));
+    width = (unsigned short)header.width;
+    height = (unsigned short)header.height;
+    bytespp = (unsigned char)header.bitsperpixel >> 3;
     if (width <= 0 || height <= 0 ||
         (bytespp != GRAYSCALE && bytespp != RGB && bytespp != RGBA)) {
-        in.close();
         std::cerr << "bad bpp (or width/height) value\n";
         return false;
     }
-    unsigned long nbytes = bytespp * width * height;
-    data = new unsigned char[nbytes];
+
+    // 跳过图像 ID 和调色板
+    size_t offset = sizeof(header) + (unsigned char)header.idlength;
+    if (header.colormaptype == 1)
+        offset += (size_t)(unsigned short)header.colormaplength * (((unsigned char)header.colormapdepth + 7) >> 3);
+    if (offset > file->size()) {
+        std::cerr << "an error occured while reading the header\n";
+        return false;
+    }
+    const unsigned char *in = begin + offset;
+
+    // 文件原点在左上角时第 0 行是最上面一行
+    bool topDown = (header.imagedescriptor & 0x20) != 0;
+    bool reverseRows = topDown == bottomUp;
+    size_t rowBytes = (size_t)width * bytespp;
+    size_t nbytes = rowBytes * height;
     if (3 == header.datatypecode || 2 == header.datatypecode) {
-        in.read((char *)data, nbytes);
-        if (!in.good()) {
-            in.close();
+        if ((size_t)(end - in) < nbytes) {
             std::cerr << "an error occured while reading the data\n";
             return false;
         }
+        if (!reverseRows) {
+            data = (unsigned char *)file->mutableData() + offset;
+            mapping = std::move(file);
+        } else {
+            data = new unsigned char[nbytes];
+            for (int y = 0; y < height; y++)
+                memcpy(data + (height - 1 - y) * rowBytes, in + y * rowBytes, rowBytes);
+        }
     } else if (10 == header.datatypecode || 11 == header.datatypecode) {
-        if (!load_rle_data(in)) {
-            in.close();
+        data = new unsigned char[nbytes];
+        if (!load_rle_data(in, end, reverseRows)) {
             std::cerr << "an error occured while reading the data\n";
+            release();
             return false;
         }
     } else {
-        in.close();
         std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
         return false;
     }
-    if (!(header.imagedescriptor & 0x20)) {
-        flip_vertically();
-    }
     if (header.imagedescriptor & 0x10) {
         flip_horizontally();
     }
     std::cerr << width << "x" << height << "/" << bytespp * 8 << "\n";
-    in.close();
     return true;
 }
 
-bool TGAImage::load_rle_data(std::ifstream &in) {
-    unsigned long pixelcount = width * height;
-    unsigned long currentpixel = 0;
-    unsigned long currentbyte = 0;
-    TGAColor colorbuffer;
-    do {
-        unsigned char chunkheader = 0;
-        chunkheader = in.get();
-        if (!in.good()) {
+/// 把 dst 开头的一个像素重复填满 n 个像素，每次拷贝已填好的部分，拷贝次数为 log(n)
+static inline void fill_pixels(unsigned char *dst, const unsigned char *pixel, size_t n, int bpp) {
+    if (bpp == 1) {
+        memset(dst, *pixel, n);
+        return;
+    }
+    size_t total = n * bpp;
+    memcpy(dst, pixel, bpp);
+    for (size_t filled = bpp; filled < total;) {
+        size_t len = std::min(filled, total - filled);
+        memcpy(dst + filled, dst, len);
+        filled += len;
+    }
+}
+
+bool TGAImage::load_rle_data(const unsigned char *in, const unsigned char *end, bool reverseRows) {
+    const size_t rowBytes = (size_t)width * bytespp;
+    auto rowStart = [&](int row) { return data + (size_t)(reverseRows ? height - 1 - row : row) * rowBytes; };
+    int row = 0;
+    unsigned char *dst = rowStart(0), *rowEnd = dst + rowBytes;
+    while (row < height) {
+        if (in >= end) {
             std::cerr << "an error occured while reading the data\n";
             return false;
         }
-        if (chunkheader < 128) {
-            chunkheader++;
-            for (int i = 0; i < chunkheader; i++) {
-                in.read((char *)colorbuffer.raw, bytespp);
-                if (!in.good()) {
-                    std::cerr << "an error occured while reading the header\n";
-                    return false;
-                }
-                for (int t = 0; t < bytespp; t++)
-                    data[currentbyte++] = colorbuffer.raw[t];
-                currentpixel++;
-                if (currentpixel > pixelcount) {
-                    std::cerr << "Too many pixels read\n";
-                    return false;
-                }
-            }
-        } else {
-            chunkheader -= 127;
-            in.read((char *)colorbuffer.raw, bytespp);
-            if (!in.good()) {
-                std::cerr << "an error occured while reading the header\n";
+        unsigned char chunkheader = *in++;
+        size_t n = (chunkheader & 0x7f) + 1;
+        bool run = chunkheader >= 128;
+        // 重复包后面跟一个像素，原始包后面跟 n 个像素
+        size_t packetBytes = run ? bytespp : n * bytespp;
+        if ((size_t)(end - in) < packetBytes) {
+            std::cerr << "an error occured while reading the data\n";
+            return false;
+        }
+        // 包可能跨行，按行切开
+        while (n > 0) {
+            if (row >= height) {
+                std::cerr << "Too many pixels read\n";
                 return false;
             }
-            for (int i = 0; i < chunkheader; i++) {
-                for (int t = 0; t < bytespp; t++)
-                    data[currentbyte++] = colorbuffer.raw[t];
-                currentpixel++;
-                if (currentpixel > pixelcount) {
-                    std::cerr << "Too many pixels read\n";
-                    return false;
-                }
+            size_t k = std::min(n, (size_t)(rowEnd - dst) / bytespp);
+            if (run) {
+                fill_pixels(dst, in, k, bytespp);
+            } else {
+                memcpy(dst, in, k * bytespp);
+                in += k * bytespp;
+            }
+            dst += k * bytespp;
+            n -= k;
+            if (dst == rowEnd && ++row < height) {
+                dst = rowStart(row);
+                rowEnd = dst + rowBytes;
             }
         }
-    } while (currentpixel < pixelcount);
+        if (run) in += bytespp;
+    }
     return true;
 }
 
-bool TGAImage::write_tga_file(const char *filename, bool rle) {
-    unsigned char developer_area_ref[4] = {0, 0, 0, 0};
-    unsigned char extension_area_ref[4] = {0, 0, 0, 0};
-    unsigned char footer[18] = {'T', 'R', 'U', 'E', 'V', 'I', 'S', 'I', 'O',
-                                'N', '-', 'X', 'F', 'I', 'L', 'E', '.', '\0'};
+bool TGAImage::write_tga_file(const char *filename, bool rle, bool bottomUp) {
+    std::vector<unsigned char> buf;
+    encode(buf, rle, bottomUp);
     std::ofstream out;
     out.open(filename, std::ios::binary);
     if (!out.is_open()) {
         std::cerr << "can't open file " << filename << "\n";
-        out.close();
         return false;
     }
+    out.write((const char *)buf.data(), (std::streamsize)buf.size());
+    if (!out.good()) {
+        std::cerr << "can't dump the tga file\n";
+        return false;
+    }
+    out.close();
+    return true;
+}
+
+void TGAImage::encode(std::vector<unsigned char> &out, bool rle, bool bottomUp) const {
+    unsigned char developer_area_ref[4] = {0, 0, 0, 0};
+    unsigned char extension_area_ref[4] = {0, 0, 0, 0};
+    unsigned char footer[18] = {'T', 'R', 'U', 'E', 'V', 'I', 'S', 'I', 'O',
+                                'N', '-', 'X', 'F', 'I', 'L', 'E', '.', '\0'};
     TGA_Header header;
     memset((void *)&header, 0, sizeof(header));
     header.bitsperpixel = bytespp << 3;
@@ -167,92 +238,90 @@ bool TGAImage::write_tga_file(const char *filename, bool rle) {
     header.height = height;
     header.datatypecode =
         (bytespp == GRAYSCALE ? (rle ? 11 : 3) : (rle ? 10 : 2));
-    header.imagedescriptor = 0x20;  // top-left origin
-    out.write((char *)&header, sizeof(header));
-    if (!out.good()) {
-        out.close();
-        std::cerr << "can't dump the tga file\n";
-        return false;
-    }
+    header.imagedescriptor = bottomUp ? 0 : 0x20;  // bottom-left / top-left origin
+
+    size_t npixels = (size_t)width * height;
+    size_t nbytes = npixels * bytespp;
+    // RLE 最坏情况是全部为原始包，每 128 个像素多一个包头
+    size_t maxData = rle ? nbytes + (npixels + 127) / 128 : nbytes;
+    out.resize(sizeof(header) + maxData + sizeof(developer_area_ref) + sizeof(extension_area_ref) +
+               sizeof(footer));
+    unsigned char *p = out.data();
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
     if (!rle) {
-        out.write((char *)data, width * height * bytespp);
-        if (!out.good()) {
-            std::cerr << "can't unload raw data\n";
-            out.close();
-            return false;
-        }
+        if (nbytes) memcpy(p, data, nbytes);
+        p += nbytes;
     } else {
-        if (!unload_rle_data(out)) {
-            out.close();
-            std::cerr << "can't unload rle data\n";
-            return false;
-        }
-    }
-    out.write((char *)developer_area_ref, sizeof(developer_area_ref));
-    if (!out.good()) {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
-    }
-    out.write((char *)extension_area_ref, sizeof(extension_area_ref));
-    if (!out.good()) {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
+        p = unload_rle_data(p);
     }
-    out.write((char *)footer, sizeof(footer));
-    if (!out.good()) {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
-    }
-    out.close();
-    return true;
+    memcpy(p, developer_area_ref, sizeof(developer_area_ref));
+    p += sizeof(developer_area_ref);
+    memcpy(p, extension_area_ref, sizeof(extension_area_ref));
+    p += sizeof(extension_area_ref);
+    memcpy(p, footer, sizeof(footer));
+    p += sizeof(footer);
+    out.resize(p - out.data());
 }
 
-// TODO: it is not necessary to break a raw chunk for two equal pixels (for the
-// matter of the resulting size)
-bool TGAImage::unload_rle_data(std::ofstream &out) {
-    const unsigned char max_chunk_length = 128;
-    unsigned long npixels = width * height;
-    unsigned long curpix = 0;
-    while (curpix < npixels) {
-        unsigned long chunkstart = curpix * bytespp;
-        unsigned long curbyte = curpix * bytespp;
-        unsigned char run_length = 1;
-        bool raw = true;
-        while (curpix + run_length < npixels && run_length < max_chunk_length) {
-            bool succ_eq = true;
-            for (int t = 0; succ_eq && t < bytespp; t++) {
-                succ_eq = (data[curbyte + t] == data[curbyte + t + bytespp]);
-            }
-            curbyte += bytespp;
-            if (1 == run_length) {
-                raw = !succ_eq;
-            }
-            if (raw && succ_eq) {
-                run_length--;
-                break;
-            }
-            if (!raw && !succ_eq) {
+/// 一个像素按整数读出，比较像素只需一次整数比较
+template <int BPP>
+static inline uint32_t load_pixel(const unsigned char *p) {
+    uint32_t v = 0;
+    memcpy(&v, p, BPP);
+    return v;
+}
+
+/*
+    连续 2 个以上相同的像素在包的开头时编码成重复包
+    原始包中间出现 r 个相同像素时，断开要多花两个包头和一个像素 (2 + BPP)，原样保留要 r * BPP：
+    灰度图两个相同像素不值得断开，至少 3 个才断；RGB/RGBA 两个相同像素断开就更省
+*/
+template <int BPP>
+static unsigned char *encode_rle(const unsigned char *data, size_t npixels, unsigned char *out) {
+    const size_t max_chunk_length = 128;
+    const size_t min_break_run = BPP == 1 ? 3 : 2;
+    size_t i = 0;
+    while (i < npixels) {
+        uint32_t first = load_pixel<BPP>(data + i * BPP);
+        size_t run = 1;
+        while (i + run < npixels && run < max_chunk_length && load_pixel<BPP>(data + (i + run) * BPP) == first)
+            run++;
+        if (run >= 2) {
+            *out++ = (unsigned char)(run + 127);
+            memcpy(out, data + i * BPP, BPP);
+            out += BPP;
+            i += run;
+            continue;
+        }
+
+        // 原始包为 [i, j)，same 为以 j 结尾的相同像素个数
+        size_t j = i + 1, same = 1;
+        uint32_t last = first;
+        for (; j < npixels && j - i < max_chunk_length; j++) {
+            uint32_t q = load_pixel<BPP>(data + j * BPP);
+            same = q == last ? same + 1 : 1;
+            last = q;
+            if (same == min_break_run) {
+                j = j + 1 - min_break_run;
                 break;
             }
-            run_length++;
-        }
-        curpix += run_length;
-        out.put(raw ? run_length - 1 : run_length + 127);
-        if (!out.good()) {
-            std::cerr << "can't dump the tga file\n";
-            return false;
-        }
-        out.write((char *)(data + chunkstart),
-                  (raw ? run_length * bytespp : bytespp));
-        if (!out.good()) {
-            std::cerr << "can't dump the tga file\n";
-            return false;
         }
+        *out++ = (unsigned char)(j - i - 1);
+        memcpy(out, data + i * BPP, (j - i) * BPP);
+        out += (j - i) * BPP;
+        i = j;
+    }
+    return out;
+}
+
+unsigned char *TGAImage::unload_rle_data(unsigned char *out) const {
+    size_t npixels = (size_t)width * height;
+    switch (bytespp) {
+        case GRAYSCALE: return encode_rle<1>(data, npixels, out);
+        case RGB: return encode_rle<3>(data, npixels, out);
+        default: return encode_rle<4>(data, npixels, out);
     }
-    return true;
 }
 
 TGAColor TGAImage::get(int x, int y) {
@@ -420,7 +489,7 @@ bool TGAImage::scale(int w, int h) {
             nscanline += nlinebytes;
         }
     }
-    delete[] data;
+    release();
     data = tdata;
     width = w;
     height = h;
@@ -2,6 +2,10 @@
 #define __IMAGE_H__
 
 #include <fstream>
+#include <memory>
+#include <vector>
+
+class MappedFile;
 
 #pragma pack(push, 1)
 struct TGA_Header {
@@ -67,9 +71,15 @@ class TGAImage {
     int width;
     int height;
     int bytespp;
+    // 未压缩的文件直接使用映射的内存（写时复制），此时 data 指向映射内部，不能 delete
+    std::unique_ptr<MappedFile> mapping;
 
-    bool load_rle_data(std::ifstream &in);
-    bool unload_rle_data(std::ofstream &out);
+    /// 解码 RLE 数据，每行直接写到最终位置
+    /// \param reverseRows 文件中的第 0 行写到最后一行
+    bool load_rle_data(const unsigned char *in, const unsigned char *end, bool reverseRows);
+    /// RLE 编码写到 out，返回写入结束的位置
+    unsigned char *unload_rle_data(unsigned char *out) const;
+    void release();
 
    public:
     enum Format { GRAYSCALE = 1, RGB = 3, RGBA = 4 };
@@ -77,8 +87,14 @@ class TGAImage {
     TGAImage();
     TGAImage(int w, int h, int bpp);
     TGAImage(const TGAImage &img);
-    bool read_tga_file(const char *filename);
-    bool write_tga_file(const char *filename, bool rle = true);
+    TGAImage(TGAImage &&img) noexcept;
+    /// \param bottomUp 为 true 时第 0 行是图像最下面一行（纹理坐标的习惯），
+    ///                 否则第 0 行是最上面一行，省去读完后再 flip_vertically()
+    bool read_tga_file(const char *filename, bool bottomUp = false);
+    /// \param bottomUp 为 true 时文件头标记原点在左下角，第 0 行是最下面一行，省去写之前 flip_vertically()
+    bool write_tga_file(const char *filename, bool rle = true, bool bottomUp = false);
+    /// 把整个文件（文件头、数据、文件尾）编码到 out 里
+    void encode(std::vector<unsigned char> &out, bool rle = true, bool bottomUp = false) const;
     bool flip_horizontally();
     bool flip_vertically();
     bool scale(int w, int h);
@@ -87,6 +103,7 @@ class TGAImage {
     bool drawline(int x0, int y0, int x1, int y1, TGAColor color);
     ~TGAImage();
     TGAImage &operator=(const TGAImage &img);
+    TGAImage &operator=(TGAImage &&img) noexcept;
     int get_width();
     int get_height();
     int get_bytespp();
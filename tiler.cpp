@@ -0,0 +1,35 @@
+﻿#include "tiler.h"
+
+#include <algorithm>
+
+
+void TileRasterizer::begin(int width, int height) {
+    width_ = width;
+    height_ = height;
+    tilesX_ = (width + TILE_SIZE - 1) / TILE_SIZE;
+    tilesY_ = (height + TILE_SIZE - 1) / TILE_SIZE;
+    bins_.resize(tilesX_ * tilesY_);
+    for (auto &bin : bins_) bin.clear();  // 保留容量，跨帧复用
+    tris_.clear();
+}
+
+
+void TileRasterizer::add(const RasterTriangle &tri) {
+    int idx = (int)tris_.size();
+    tris_.push_back(tri);
+    int tx0 = tri.minX / TILE_SIZE, tx1 = (tri.maxX - 1) / TILE_SIZE;
+    int ty0 = tri.minY / TILE_SIZE, ty1 = (tri.maxY - 1) / TILE_SIZE;
+    for (int ty = ty0; ty <= ty1; ty++)
+        for (int tx = tx0; tx <= tx1; tx++)
+            bins_[tx + ty * tilesX_].push_back(idx);
+}
+
+
+void TileRasterizer::sortTiles() {
+    order_.clear();
+    for (int i = 0; i < (int)bins_.size(); i++)
+        if (!bins_[i].empty()) order_.push_back(i);
+    // 三角形多的 tile 先开始，少的留给空闲线程偷
+    std::stable_sort(order_.begin(), order_.end(),
+                     [&](int a, int b) { return bins_[a].size() > bins_[b].size(); });
+}
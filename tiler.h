@@ -0,0 +1,70 @@
+﻿#ifndef TILER_H_
+#define TILER_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "depthbuffer.h"
+#include "framebuffer.h"
+#include "parallel.h"
+#include "raster.h"
+
+
+/*
+    分块 (tile) 光栅化
+    1. 顶点阶段产生的三角形按包围盒放进覆盖到的 tile 的 bin 里
+    2. 各 tile 并行光栅化，每个 tile 只写自己那一块颜色缓冲和 zBuffer，像素路径上不需要加锁
+    每个 tile 内按提交顺序处理三角形，逐像素计算和单线程完全相同，所以输出逐位一致
+*/
+class TileRasterizer {
+public:
+    static constexpr int TILE_SIZE = 64;
+    static_assert(TILE_SIZE % DepthBuffer::COARSE == 0, "tiles must not share coarse depth blocks");
+    static_assert(TILE_SIZE == Framebuffer::TILE, "framebuffer clears must follow raster tiles");
+
+    /// 开始新的一帧，清空所有 bin
+    void begin(int width, int height);
+
+    /// 提交一个已经 setup 好的三角形
+    void add(const RasterTriangle &tri);
+
+    /// 并行光栅化所有 tile，每个 tile 按提交顺序对其中的三角形调用 raster(tri, idx)
+    /// \param fb 非空时每个 tile 画第一个三角形之前先让它延迟清掉这一块
+    /// \param raster tri 的包围盒已截到 tile 内，idx 是三角形 add() 的顺序；不同 tile 在不同线程上调用
+    template <class Raster>
+    void flush(ThreadPool &pool, Framebuffer *fb, Raster &&raster);
+
+    [[nodiscard]] int nTriangles() const { return (int)tris_.size(); }
+
+private:
+    /// 非空 tile 按工作量排进 order_
+    void sortTiles();
+
+    int width_ = 0, height_ = 0;
+    int tilesX_ = 0, tilesY_ = 0;
+    std::vector<RasterTriangle> tris_;
+    std::vector<std::vector<int>> bins_;  // 每个 tile 覆盖到的三角形下标，按提交顺序
+    std::vector<int> order_;              // 非空 tile，按工作量从大到小排列
+};
+
+
+template <class Raster>
+void TileRasterizer::flush(ThreadPool &pool, Framebuffer *fb, Raster &&raster) {
+    sortTiles();
+    pool.run((int)order_.size(), [&](int task) {
+        int tile = order_[task];
+        int x0 = (tile % tilesX_) * TILE_SIZE, y0 = (tile / tilesX_) * TILE_SIZE;
+        int x1 = std::min(x0 + TILE_SIZE, width_), y1 = std::min(y0 + TILE_SIZE, height_);
+        if (fb) fb->prepareTile(tile);
+        for (int idx : bins_[tile]) {
+            RasterTriangle tri = tris_[idx];
+            tri.minX = std::max(tri.minX, x0);
+            tri.maxX = std::min(tri.maxX, x1);
+            tri.minY = std::max(tri.minY, y0);
+            tri.maxY = std::min(tri.maxY, y1);
+            raster(tri, idx);
+        }
+    });
+}
+
+#endif //TILER_H_
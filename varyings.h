@@ -0,0 +1,142 @@
+﻿#ifndef VARYINGS_H_
+#define VARYINGS_H_
+
+#include "raster.h"
+#include "rasterimpl.h"
+
+
+/*
+    透视矫正的 varyings 插值
+    屏幕空间线性的不是属性 v 本身，而是 v / w 和 1 / w。每个三角形 setup 时把这 N + 1 个量
+    写成屏幕坐标的平面方程，光栅化时逐像素求两个平面再相除：
+        v = (c + dx * Δx + dy * Δy) / (c' + dx' * Δx + dy' * Δy)
+    Δx/Δy 是像素中心相对 RasterTriangle::x0/y0 的偏移。每个像素一次除法，每个属性两次乘加，
+    属性再多也不用逐个调用插值函数；AVX2 路径一次算一行 8 个像素，结果按属性分组 (SoA) 存放
+    透视矫正后属性对屏幕坐标的偏导也随位置变化，着色器要的偏导 (Shader::DERIVATIVES) 和 GPU 一样
+    每个 2x2 像素块 (quad) 算一份，取块中心处的解析导数，块里 4 个像素共用，选 mip 层用
+*/
+
+/// 插值后的 varyings，fragment 阶段按下标读取
+class Varyings {
+public:
+    /// \param stride 相邻两个 varying 相隔几个 float，8 个像素按属性分组存放时为 8，偏导的存放方式相同
+    /// \param ddx 前 Shader::DERIVATIVES 个 varying 对屏幕 x 的偏导，没有要求偏导时为空
+    explicit Varyings(const float *data, int stride = 1, const float *ddx = nullptr, const float *ddy = nullptr)
+        : data_(data), ddx_(ddx), ddy_(ddy), stride_(stride) {}
+
+    float operator[](int i) const { return data_[i * stride_]; }
+
+    /// 第 i 个 varying 对屏幕 x/y 的偏导，所在 2x2 像素块共用，i < Shader::DERIVATIVES
+    [[nodiscard]] float ddx(int i) const { return ddx_[i * stride_]; }
+    [[nodiscard]] float ddy(int i) const { return ddy_[i * stride_]; }
+
+private:
+    const float *data_;
+    const float *ddx_, *ddy_;
+    int stride_;
+};
+
+
+/// N 个 varying 的 v / w 和 1 / w 的平面方程，下标 N 是 1 / w
+template <int N>
+struct VaryingPlanes {
+    float c[N + 1];   // 在 (x0, y0) 处的值
+    float dx[N + 1];  // 对屏幕 x 的偏导
+    float dy[N + 1];  // 对屏幕 y 的偏导
+};
+
+/// 三角形 setup 时算一次平面方程
+/// \param vars 三个顶点的 varyings，各 N 个
+/// \param invW 三个顶点的 1 / w
+template <int N>
+inline void setupPlanes(const RasterTriangle &tri, const float *const *vars, const float *invW,
+                        VaryingPlanes<N> &planes) {
+    for (int k = 0; k <= N; k++) {
+        float a0 = k < N ? vars[0][k] * invW[0] : invW[0];
+        float a1 = k < N ? vars[1][k] * invW[1] : invW[1];
+        float a2 = k < N ? vars[2][k] * invW[2] : invW[2];
+        float d1 = a1 - a0, d2 = a2 - a0;
+        planes.c[k] = a0;
+        planes.dx[k] = d1 * tri.a1 + d2 * tri.a2;
+        planes.dy[k] = d1 * tri.b1 + d2 * tri.b2;
+    }
+}
+
+/// 偏移 (dx, dy) 处透视矫正后的 N 个 varying
+template <int N>
+inline void interpolatePlanes(const VaryingPlanes<N> &p, float dx, float dy, float *out) {
+    if constexpr (N > 0) {
+        float w = 1.f / (p.c[N] + p.dx[N] * dx + p.dy[N] * dy);
+        for (int k = 0; k < N; k++) out[k] = (p.c[k] + p.dx[k] * dx + p.dy[k] * dy) * w;
+    }
+}
+
+/// 像素 x（或 y）所在 2x2 像素块的中心相对插值原点 origin 的偏移
+inline float quadOffset(int x, float origin) { return (float)((x & ~1) + 1) - origin; }
+
+/// 偏移 (dx, dy) 处前 D 个 varying 对屏幕 x/y 的偏导，(dx, dy) 取 quadOffset()
+template <int D, int N>
+inline void planeDerivatives(const VaryingPlanes<N> &p, float dx, float dy, float *ddx, float *ddy) {
+    static_assert(D <= N, "derivatives of at most all varyings");
+    float w = 1.f / (p.c[N] + p.dx[N] * dx + p.dy[N] * dy);
+    for (int k = 0; k < D; k++) {
+        // (P / Q)' = (P' - (P / Q) * Q') / Q
+        float v = (p.c[k] + p.dx[k] * dx + p.dy[k] * dy) * w;
+        ddx[k] = (p.dx[k] - v * p.dx[N]) * w;
+        ddy[k] = (p.dy[k] - v * p.dy[N]) * w;
+    }
+}
+
+
+#ifdef TR_X86
+
+/// 一行中 8 个像素的 N 个 varying，out[k][lane]
+/// \param dx pixelDx8() 的结果
+/// \param dy 这一行相对 y0 的偏移
+/// 加法顺序和 interpolatePlanes() 相同，结果和标量实现逐位一致
+template <int N>
+TR_TARGET_AVX2 inline void interpolatePlanes8(const VaryingPlanes<N> &p, __m256 dx, float dy, float (*out)[8]) {
+    if constexpr (N > 0) {
+        __m256 q = _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(p.c[N]), _mm256_mul_ps(_mm256_set1_ps(p.dx[N]), dx)),
+                                 _mm256_set1_ps(p.dy[N] * dy));
+        __m256 w = _mm256_div_ps(_mm256_set1_ps(1.f), q);
+        for (int k = 0; k < N; k++) {
+            __m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(p.c[k]), _mm256_mul_ps(_mm256_set1_ps(p.dx[k]), dx)),
+                                     _mm256_set1_ps(p.dy[k] * dy));
+            _mm256_store_ps(out[k], _mm256_mul_ps(v, w));
+        }
+    }
+}
+
+/// 一行中从 x 开始的 8 个像素各自所在 2x2 像素块的中心相对插值原点的 x 偏移，和 quadOffset() 逐位一致
+/// \param x 偶数
+TR_TARGET_AVX2 inline __m256 quadDx8(const RasterTriangle &tri, int x) {
+    const __m256i quadCenter = _mm256_setr_epi32(1, 1, 3, 3, 5, 5, 7, 7);
+    __m256 px = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(x), quadCenter));
+    return _mm256_sub_ps(px, _mm256_set1_ps(tri.x0));
+}
+
+/// 8 个像素所在 2x2 像素块的前 D 个偏导，ddx[k][lane]，运算顺序和 planeDerivatives() 相同
+/// \param dx quadDx8() 的结果
+/// \param dy 这一行的 quadOffset()
+template <int D, int N>
+TR_TARGET_AVX2 inline void planeDerivatives8(const VaryingPlanes<N> &p, __m256 dx, float dy, float (*ddx)[8],
+                                             float (*ddy)[8]) {
+    static_assert(D <= N, "derivatives of at most all varyings");
+    __m256 q = _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(p.c[N]), _mm256_mul_ps(_mm256_set1_ps(p.dx[N]), dx)),
+                             _mm256_set1_ps(p.dy[N] * dy));
+    __m256 w = _mm256_div_ps(_mm256_set1_ps(1.f), q);
+    for (int k = 0; k < D; k++) {
+        __m256 v = _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(p.c[k]), _mm256_mul_ps(_mm256_set1_ps(p.dx[k]), dx)),
+                                 _mm256_set1_ps(p.dy[k] * dy));
+        v = _mm256_mul_ps(v, w);
+        __m256 vdx = _mm256_sub_ps(_mm256_set1_ps(p.dx[k]), _mm256_mul_ps(v, _mm256_set1_ps(p.dx[N])));
+        __m256 vdy = _mm256_sub_ps(_mm256_set1_ps(p.dy[k]), _mm256_mul_ps(v, _mm256_set1_ps(p.dy[N])));
+        _mm256_store_ps(ddx[k], _mm256_mul_ps(vdx, w));
+        _mm256_store_ps(ddy[k], _mm256_mul_ps(vdy, w));
+    }
+}
+
+#endif // TR_X86
+
+#endif //VARYINGS_H_
@@ -0,0 +1,8 @@
+﻿#include "vertex.h"
+
+
+Mat4 concatMVP(const Mat4 &modelM, const Mat4 &viewM, const Mat4 &projM, const Mat4 &viewportM) {
+    // viewport 是仿射变换（最后一行为 0 0 0 1），和透视除法可交换顺序，
+    // 所以可以先整体相乘，最后再除以 w
+    return viewportM * projM * viewM * modelM;
+}
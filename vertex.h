@@ -0,0 +1,72 @@
+﻿#ifndef VERTEX_H_
+#define VERTEX_H_
+
+#include <vector>
+
+#include "GMath.h"
+#include "model.h"
+
+
+/*
+    逐帧顶点处理阶段
+    model/view/projection/viewport 每帧只连乘一次，
+    每个顶点只经过一次着色器的 vertex()（pipeline.h 的 setupMesh()），结果按结构体数组 (SoA) 连续存放，光栅化时按下标取
+*/
+struct ScreenVertices {
+    std::vector<float> x, y, z;  // 视口空间坐标，已做透视除法
+    std::vector<float> invW;     // 1/w，透视矫正插值用
+    std::vector<unsigned char> clip;  // ClipBits，视锥剔除用
+    std::vector<float> varyings;      // 着色器输出的 varyings，每个顶点的连续存放，见 pipeline.h
+
+    void resize(int n) {
+        x.resize(n);
+        y.resize(n);
+        z.resize(n);
+        invW.resize(n);
+        clip.resize(n);
+    }
+
+    [[nodiscard]] int size() const { return (int)x.size(); }
+
+    [[nodiscard]] Vec3f pos(int i) const { return {x[i], y[i], z[i]}; }
+};
+
+
+/// 顶点在视锥哪些面的外侧，三个顶点的 ClipBits 按位与不为 0 时三角形整个在视锥外
+enum ClipBits : unsigned char {
+    CLIP_LEFT = 1,
+    CLIP_RIGHT = 2,
+    CLIP_BOTTOM = 4,
+    CLIP_TOP = 8,
+    CLIP_NEAR = 16,
+    CLIP_FAR = 32,
+    CLIP_GUARD = 64,  // 超出屏幕四周的保护带，见 clip.h，不参与按位与剔除
+};
+
+/// 视锥在屏幕空间的范围 [0, width] * [0, height] * [0, depth]，guard 为保护带宽度
+struct ScreenBounds {
+    float width, height, depth;
+    float guard;
+};
+
+/// \param x, y, z 透视除法之后的屏幕坐标
+/// \param w 透视除法之前的 w，相机前方为负；w >= 0 的点在相机后面，屏幕坐标没有意义，只标 CLIP_NEAR
+inline unsigned char clipBits(float x, float y, float z, float w, const ScreenBounds &bounds) {
+    if (!(w < 0)) return CLIP_NEAR;
+    unsigned char bits = 0;
+    if (x < 0) bits |= CLIP_LEFT;
+    if (x > bounds.width) bits |= CLIP_RIGHT;
+    if (y < 0) bits |= CLIP_BOTTOM;
+    if (y > bounds.height) bits |= CLIP_TOP;
+    if (z > bounds.depth) bits |= CLIP_NEAR;
+    if (z < 0) bits |= CLIP_FAR;
+    if (x < -bounds.guard || x > bounds.width + bounds.guard || y < -bounds.guard || y > bounds.height + bounds.guard)
+        bits |= CLIP_GUARD;
+    return bits;
+}
+
+
+/// viewport * projection * view * model，每帧算一次
+Mat4 concatMVP(const Mat4 &modelM, const Mat4 &viewM, const Mat4 &projM, const Mat4 &viewportM);
+
+#endif //VERTEX_H_
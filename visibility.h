@@ -0,0 +1,174 @@
+﻿#ifndef VISIBILITY_H_
+#define VISIBILITY_H_
+
+#include <cstdint>
+
+#include "GMath.h"
+#include "deferred.h"
+#include "framebuffer.h"
+#include "gbuffer.h"
+#include "image.h"
+#include "model.h"
+#include "parallel.h"
+#include "pipeline.h"
+#include "render.h"
+#include "shader.h"
+#include "tgaimage.h"
+
+
+/*
+    可见性缓冲 (visibility buffer)
+    光栅化只写深度和一个 32 位编号：高 8 位是实例号 + 1，低 24 位是三角形在模型索引数组中的序号，0 表示没有画到。
+    没有 varying，片元阶段只是一次 4 字节的存储，比前向渲染和 G-buffer 都省带宽
+    之后的全屏着色 shadeVisibility() 对每个可见像素按编号找回三角形，从 Model 的顶点数据重新算出
+    重心坐标、纹理坐标、法线和 mip 层，交给和延迟着色相同的 Lighting::shade() (deferred.h)
+    resolve() 之后编号缓冲就是完整的一帧，pick() 直接读它，不用另外渲染一遍
+*/
+
+constexpr int VISIBILITY_TRIANGLE_BITS = 24;
+constexpr int VISIBILITY_MAX_TRIANGLES = 1 << VISIBILITY_TRIANGLE_BITS;
+constexpr int VISIBILITY_MAX_INSTANCES = 255;
+
+/// \param instance 0..VISIBILITY_MAX_INSTANCES - 1
+/// \param triangle 0..VISIBILITY_MAX_TRIANGLES - 1
+inline uint32_t visibilityId(int instance, int triangle) {
+    return ((uint32_t)(instance + 1) << VISIBILITY_TRIANGLE_BITS) | (uint32_t)triangle;
+}
+
+/// 编号为 0（没有画到）时返回 -1
+inline int visibilityInstance(uint32_t id) { return (int)(id >> VISIBILITY_TRIANGLE_BITS) - 1; }
+
+inline int visibilityTriangle(uint32_t id) { return (int)(id & (VISIBILITY_MAX_TRIANGLES - 1)); }
+
+
+/// 光栅化目标：fragment() 输出编号
+struct VisibilityTarget {
+    ImageView<Id32> ids;
+
+    template <class Shader>
+    bool shade(const Shader &shader, const typename Shader::Flat &flat, Varyings in, int x, int y) const {
+        return shader.fragment(flat, in, ids.at(x, y));
+    }
+};
+
+
+/*
+    一个实例：模型和它的矩阵，光栅化时输出编号，着色时重建像素上的属性
+    重建用齐次坐标下的重心坐标：三个顶点乘过 viewport 的裁剪坐标 c_i = (X_i, Y_i, W_i)，
+    像素中心 p = (x + 0.5, y + 0.5, 1)，透视矫正的重心坐标正比于 (c_1 × c_2, c_2 × c_0, c_0 × c_1) · p，
+    归一化到和为 1。不需要先做透视除法，被近平面裁过的三角形（有顶点在相机后面）也成立
+    p 移动一个像素时分子线性变化，纹理坐标的屏幕偏导和 mip 层逐像素算，比逐三角形算的更准
+*/
+class VisibilityShader : public IShader<VisibilityShader, 0, uint32_t> {
+public:
+    /// \param instance 写进编号的实例号，0..VISIBILITY_MAX_INSTANCES - 1，shadeVisibility() 按它找回实例
+    explicit VisibilityShader(Model *model, int instance = 0) : model_(model), instance_(instance) {}
+
+    [[nodiscard]] Model *model() const { return model_; }
+
+    [[nodiscard]] int instance() const { return instance_; }
+
+    Vec4f vertex(int vert, float *) const { return mvp() * Vec4f(model_->verts()[vert], 1.f); }
+
+    uint32_t triangle(int face, const Vec3f *) const {
+        return visibilityId(instance_, face);
+    }
+
+    bool fragment(const uint32_t &id, Varyings, uint32_t &out) const {
+        out = id;
+        return true;
+    }
+
+    /// 重建像素 (x, y) 上三角形 face 的属性，material 填实例号 + 1
+    /// \param depth 深度缓冲中的值，原样放进结果
+    GBufferSample reconstruct(int face, int x, int y, float depth) const {
+        const int *idx = model_->face(face);
+        Vec3f c[3];
+        for (int i = 0; i < 3; i++) {
+            Vec4f h = mvp() * Vec4f(model_->verts()[idx[i]], 1.f);
+            c[i] = Vec3f(h.x, h.y, h.w);
+        }
+        Vec3f e[3] = {cross(c[1], c[2]), cross(c[2], c[0]), cross(c[0], c[1])};
+        Vec3f p((float)x + 0.5f, (float)y + 0.5f, 1.f);
+        float q[3] = {e[0] * p, e[1] * p, e[2] * p};
+
+        const Vec2f *uvs = model_->uvs();
+        Vec2f uv0 = uvs[idx[0]], uv1 = uvs[idx[1]], uv2 = uvs[idx[2]];
+        // 分子 q 加上 dq 后的纹理坐标，dq 为 0 就是像素中心的
+        auto uvAt = [&](float dq0, float dq1, float dq2) {
+            float b0 = q[0] + dq0, b1 = q[1] + dq1, b2 = q[2] + dq2;
+            float inv = 1.f / (b0 + b1 + b2);
+            return Vec2f((b0 * uv0.x + b1 * uv1.x + b2 * uv2.x) * inv, (b0 * uv0.y + b1 * uv1.y + b2 * uv2.y) * inv);
+        };
+        Vec2f uv = uvAt(0.f, 0.f, 0.f);
+        Vec2f uvdx = uvAt(e[0].x, e[1].x, e[2].x) - uv;
+        Vec2f uvdy = uvAt(e[0].y, e[1].y, e[2].y) - uv;
+
+        float inv = 1.f / (q[0] + q[1] + q[2]);
+        const Vec3f *normals = model_->normals();
+        Vec3f n = (normals[idx[0]] * q[0] + normals[idx[1]] * q[1] + normals[idx[2]] * q[2]) * inv;
+        Vec4f nv = modelView() * Vec4f(n, 0.f);
+        Vec3f normal(nv.x, nv.y, nv.z);
+        if (normal.norm() > 0.f) normal.normalize();
+        else normal = Vec3f(0, 0, 1);  // 模型没有法线时按朝向相机
+
+        return {x, y, depth, uv, normal, model_->diffuseLod(uvdx, uvdy), instance_ + 1};
+    }
+
+private:
+    Model *model_;
+    int instance_;
+};
+
+
+/// 把模型画进 fb 的可见性缓冲，先用模型包围盒做整体的视锥剔除，同 drawModel()
+/// \return fb 没有打开可见性缓冲，或三角形数、实例号超出编号的范围时返回 false
+inline bool drawModelVisibility(Framebuffer &fb, Model *model, const VisibilityShader &shader, RenderState &state) {
+    if (!fb.hasVisibility() || model->nFaces() > VISIBILITY_MAX_TRIANGLES) return false;
+    if (shader.instance() < 0 || shader.instance() >= VISIBILITY_MAX_INSTANCES) return false;
+    if (modelOutsideFrustum(fb.width(), fb.height(), model, shader, state)) return true;
+    setupMesh(fb.width(), fb.height(), shader, model->nVert(), model->indices(), model->nFaces(), state);
+    flushMesh(VisibilityTarget{fb.visibility()}, fb.depth(), &fb, shader, state);
+    return true;
+}
+
+
+/// 全屏着色，按编号重建每个可见像素的属性再交给 lighting.shade()
+/// 在所有实例的 drawModelVisibility() 之后、fb.resolve() 之前调用
+/// \param instances 按实例号排列，编号里的实例号超出 nInstances 的像素不着色
+/// \return fb 没有打开可见性缓冲或颜色缓冲格式不支持时返回 false
+template <class Lighting>
+bool shadeVisibility(Framebuffer &fb, const VisibilityShader *instances, int nInstances, const Lighting &lighting,
+                     ThreadPool &pool) {
+    if (!fb.hasVisibility()) return false;
+    const ImageView<Id32> ids = fb.visibility();
+    const ImageView<DepthF32> depth = fb.depth().view();
+    return shadeScreen(fb, pool, [&](int x, int y, TGAColor &color) {
+        uint32_t id = ids.at(x, y);
+        int instance = visibilityInstance(id);
+        if (instance < 0 || instance >= nInstances) return false;
+        color = lighting.shade(instances[instance].reconstruct(visibilityTriangle(id), x, y, depth.at(x, y)));
+        return true;
+    });
+}
+
+
+/// 拾取结果
+struct PickResult {
+    int instance;  // 实例号
+    int triangle;  // 三角形在模型索引数组中的序号
+    float depth;   // 深度缓冲中的值
+};
+
+/// 读可见性缓冲中像素 (x, y) 上的三角形，在 fb.resolve() 之后调用
+/// \param y 和颜色缓冲相同，原点在左下角
+/// \return 像素在屏幕外、没有画到或 fb 没有打开可见性缓冲时返回 false
+inline bool pick(Framebuffer &fb, int x, int y, PickResult &result) {
+    if (!fb.hasVisibility() || !fb.visibility().contains(x, y)) return false;
+    uint32_t id = fb.visibility().at(x, y);
+    if (!id) return false;
+    result = {visibilityInstance(id), visibilityTriangle(id), fb.depth().view().at(x, y)};
+    return true;
+}
+
+#endif //VISIBILITY_H_